@@ -0,0 +1,179 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <glm/glm.hpp>
+#include "Map.hpp"
+#include "ECS.hpp"
+#include "Components.hpp"
+#include "StateBuffer.hpp"
+
+
+// Spreads the thinking of many agents over the ticks | Agents near the view think every tick, far ones every few ticks
+namespace ai {
+
+	enum tier : uint8_t {TIER_NEAR = 0, TIER_MID, TIER_FAR};
+
+	// Ticks between two thoughts of an agent outside the view
+	const int MID_INTERVAL = 4;
+	const int FAR_INTERVAL = 16;
+	// Distance from the view beyond which agents count as far
+	const float MID_DISTANCE = 16.0f;
+	// Milliseconds of thinking per tick | Agents left over keep their turn for the next tick
+	const float AI_BUDGET_MS = 1.0f;
+	// Agents handed to think at once | The clock is checked between two chunks
+	const uint32_t THINK_CHUNK = 32;
+
+	// Scheduling state of an agent | Added to every entity that thinks
+	struct Brain {
+		uint8_t tier;
+		// Bucket of the agent | Agents of a tier with the same bucket think on the same ticks
+		uint8_t phase;
+		// Ticks since the agent last thought
+		uint16_t waited;
+	};
+
+	struct SchedulerStats {
+		uint32_t agents = 0;
+		uint32_t near = 0, mid = 0, far = 0;
+		// Agents whose turn it was and those of them that got to think
+		uint32_t due = 0, thought = 0;
+		// Longest an agent had to wait this tick
+		uint16_t mostWaited = 0;
+		float ms = 0;
+	};
+
+	// Tile line of sight | Walks the cells the segment crosses and stops at the first solid one
+	inline bool lineOfSight(const gameMap::Map& map, glm::vec2 from, glm::vec2 to) {
+		glm::vec2 delta = to - from;
+		int x = static_cast<int>(std::floor(from.x)), y = static_cast<int>(std::floor(from.y));
+		int endX = static_cast<int>(std::floor(to.x)), endY = static_cast<int>(std::floor(to.y));
+		int stepX = delta.x > 0 ? 1 : -1, stepY = delta.y > 0 ? 1 : -1;
+		// Fraction of the segment at which it crosses the next vertical and horizontal cell border
+		float tx = delta.x != 0 ? ((stepX > 0 ? x + 1 : x) - from.x) / delta.x : 2.0f;
+		float ty = delta.y != 0 ? ((stepY > 0 ? y + 1 : y) - from.y) / delta.y : 2.0f;
+		float dx = delta.x != 0 ? stepX / delta.x : 2.0f, dy = delta.y != 0 ? stepY / delta.y : 2.0f;
+		while (x != endX || y != endY) {
+			if (map.isSolid(x, y))
+				return false;
+			if (tx < ty) {
+				x += stepX;
+				tx += dx;
+			}
+			else {
+				y += stepY;
+				ty += dy;
+			}
+			if (tx > 1.0f && ty > 1.0f)
+				break;
+		}
+		return !map.isSolid(endX, endY);
+	}
+
+	// Decides each tick which agents think | Every agent is a Brain and a Motion in the registry
+	// Near agents go first, then the ones that waited longest, until the budget runs out
+	// A time budget makes the result depend on the machine, so lockstep and rollback games set budgetMs to 0 and use maxThoughts
+	class Scheduler {
+	private:
+		struct Candidate {
+			// Lower thinks first
+			uint32_t priority;
+			ecs::Entity entity;
+
+			bool operator<(const Candidate& o) const {
+				return priority != o.priority ? priority < o.priority : entity < o.entity;
+			}
+		};
+
+		std::vector<Candidate> due;
+		// Current chunk
+		std::vector<ecs::Entity> chunk;
+		std::vector<uint16_t> chunkWaited;
+		uint64_t tick = 0;
+		uint8_t nextPhase = 0;
+
+		// Distance from pos to the rectangle [min, max] | 0 inside it
+		static float distanceTo(glm::vec2 pos, glm::vec2 min, glm::vec2 max) {
+			return glm::length(glm::max(glm::max(min - pos, pos - max), glm::vec2(0)));
+		}
+
+		bool isDue(const Brain& brain) const {
+			if (brain.tier == TIER_NEAR)
+				return true;
+			int interval = brain.tier == TIER_MID ? midInterval : farInterval;
+			// Agents that missed their tick because of the budget go as soon as possible
+			return brain.waited >= interval && ((tick + brain.phase) % interval == 0 || brain.waited > interval);
+		}
+	public:
+		int midInterval = MID_INTERVAL, farInterval = FAR_INTERVAL;
+		float midDistance = MID_DISTANCE;
+		// 0 turns the clock off
+		float budgetMs = AI_BUDGET_MS;
+		uint32_t maxThoughts = 0xFFFFFFFF;
+		SchedulerStats stats;
+
+		// Brain for a new agent | Consecutive agents land in different buckets
+		Brain makeBrain() {
+			return Brain{ TIER_FAR, nextPhase++, 0 };
+		}
+
+		// Calls think(entities, waited, count) with the agents whose turn it is, in chunks of up to THINK_CHUNK
+		// waited is the ticks each of them went without thinking | view is the camera rectangle, grown to hold the player
+		// think must not add or remove components
+		template<typename F>
+		void update(ecs::Registry& registry, glm::vec2 viewMin, glm::vec2 viewMax, F think) {
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			stats = SchedulerStats();
+			due.clear();
+			registry.each<Brain, gameEntity::Motion>([&](ecs::Entity entity, Brain& brain, gameEntity::Motion& motion) {
+				float distance = distanceTo(motion.pos, viewMin, viewMax);
+				brain.tier = distance == 0 ? TIER_NEAR : distance < midDistance ? TIER_MID : TIER_FAR;
+				if (brain.waited < 0xFFFF)
+					++brain.waited;
+				++(brain.tier == TIER_NEAR ? stats.near : brain.tier == TIER_MID ? stats.mid : stats.far);
+				if (isDue(brain))
+					due.push_back({ brain.tier == TIER_NEAR ? 0u : 0x10000u - brain.waited, entity });
+			});
+			std::sort(due.begin(), due.end());
+			stats.agents = stats.near + stats.mid + stats.far;
+			stats.due = static_cast<uint32_t>(due.size());
+
+			size_t next = 0;
+			while (next < due.size() && stats.thought < maxThoughts) {
+				if (budgetMs > 0 && next > 0) {
+					float ms = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() / 1e6f;
+					if (ms >= budgetMs)
+						break;
+				}
+				size_t count = std::min<size_t>(std::min<size_t>(THINK_CHUNK, due.size() - next), maxThoughts - stats.thought);
+				chunk.resize(count);
+				chunkWaited.resize(count);
+				for (size_t k = 0; k < count; ++k) {
+					Brain& brain = *registry.get<Brain>(due[next + k].entity);
+					chunk[k] = due[next + k].entity;
+					chunkWaited[k] = brain.waited;
+					stats.mostWaited = std::max(stats.mostWaited, brain.waited);
+					brain.waited = 0;
+				}
+				think(chunk.data(), chunkWaited.data(), count);
+				next += count;
+				stats.thought += static_cast<uint32_t>(count);
+			}
+			++tick;
+			stats.ms = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() / 1e6f;
+		}
+
+		// Brains are components and saved with the registry, this is the tick count the buckets follow
+		void save(physics::StateBuffer& buffer) const {
+			buffer.write(tick);
+			buffer.write(nextPhase);
+		}
+
+		void restore(physics::StateBuffer& buffer) {
+			buffer.read(tick);
+			buffer.read(nextPhase);
+		}
+	};
+}
\ No newline at end of file
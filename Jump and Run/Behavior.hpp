@@ -0,0 +1,243 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <cstdint>
+#include <cctype>
+#include <cstdlib>
+
+
+// Behavior trees written as text and compiled into one flat array of leaves per tree
+// Composites only decide where to go after a leaf, so compiling turns them into jump targets
+// Agents only keep an AgentState, the interpreter hops from leaf to leaf without stack or allocation
+namespace behavior {
+
+	enum status : uint8_t {FAILURE = 0, SUCCESS, RUNNING};
+
+	// Sequences stop at the first child that doesn't succeed, selectors at the first that doesn't fail
+	// invert swaps success and failure of its one child | Leaves are conditions and actions named by the game
+	enum opCode : uint8_t {OP_SEQUENCE = 0, OP_SELECTOR, OP_INVERT, OP_LEAF};
+
+	const uint16_t NO_NODE = 0xFFFF;
+	// Jump targets from DONE on end the run with status target - DONE
+	const uint16_t DONE = 0xFFF0;
+	// Nesting depth of composites a tree may use
+	const int MAX_DEPTH = 32;
+
+	// Tree as written, nodes in pre-order | A composite's children follow it and end is one past its last descendant
+	struct Node {
+		opCode op;
+		uint8_t leaf;
+		uint16_t end;
+		// Number given to a leaf, 0 if none
+		float arg;
+	};
+
+	// One leaf of the tree | Runs next go on at next[result] for FAILURE and SUCCESS, RUNNING always ends the run
+	struct Instruction {
+		uint8_t leaf;
+		uint16_t next[2];
+		float arg;
+	};
+
+	struct Program {
+		std::vector<Node> nodes;
+		// Leaves in pre-order, the run starts at 0
+		std::vector<Instruction> code;
+	};
+
+	// Sets the jump targets of the leaves below node | Every node continues with onSuccess or onFailure when done
+	inline void link(Program& program, const std::vector<uint16_t>& leafOf, size_t node, uint16_t onSuccess, uint16_t onFailure) {
+		const Node& n = program.nodes[node];
+		if (n.op == OP_LEAF) {
+			Instruction& instruction = program.code[leafOf[node]];
+			instruction.next[SUCCESS] = onSuccess;
+			instruction.next[FAILURE] = onFailure;
+			return;
+		}
+		if (n.op == OP_INVERT) {
+			link(program, leafOf, node + 1, onFailure, onSuccess);
+			return;
+		}
+		for (size_t child = node + 1; child < n.end; child = program.nodes[child].end) {
+			size_t sibling = program.nodes[child].end;
+			bool last = sibling == n.end;
+			if (n.op == OP_SEQUENCE)
+				link(program, leafOf, child, last ? onSuccess : leafOf[sibling], onFailure);
+			else
+				link(program, leafOf, child, onSuccess, last ? onFailure : leafOf[sibling]);
+		}
+	}
+
+	// All an agent keeps between ticks
+	struct AgentState {
+		// Program the agent runs
+		uint16_t tree;
+		// Leaf that returned RUNNING last time | Its timer keeps counting while the same leaf keeps running
+		uint16_t running;
+		// Seconds the running leaf has been at it
+		float timer;
+	};
+
+	inline AgentState makeAgent(uint16_t tree) {
+		return AgentState{ tree, NO_NODE, 0.0f };
+	}
+
+	// Text form, one node per parenthesis and # comments to the end of the line:
+	//   (selector (sequence (playerWithin 8) (chase)) (walk))
+	// leafNames are the leaves the game offers, a leaf's id is its index | Returns false and sets error on bad input
+	inline bool compile(const std::string& text, const std::vector<std::string>& leafNames, Program& program, std::string& error) {
+		program.nodes.clear();
+		program.code.clear();
+		std::vector<size_t> open;
+		size_t at = 0, line = 1;
+		bool done = false;
+
+		auto fail = [&](const std::string& message) {
+			error = "line " + std::to_string(line) + ": " + message;
+			program.nodes.clear();
+			program.code.clear();
+			return false;
+		};
+		auto skipSpace = [&] {
+			while (at < text.size()) {
+				if (text[at] == '#') {
+					while (at < text.size() && text[at] != '\n')
+						++at;
+				}
+				else if (std::isspace(static_cast<unsigned char>(text[at]))) {
+					line += text[at] == '\n';
+					++at;
+				}
+				else {
+					break;
+				}
+			}
+		};
+
+		while (true) {
+			skipSpace();
+			if (at == text.size())
+				break;
+			if (done)
+				return fail("text after the root node");
+			char c = text[at];
+			if (c == ')') {
+				if (open.empty())
+					return fail("unmatched )");
+				Node& node = program.nodes[open.back()];
+				size_t children = 0;
+				for (size_t i = open.back() + 1; i < program.nodes.size(); i = program.nodes[i].end)
+					++children;
+				if (node.op != OP_LEAF && children == 0)
+					return fail("composite without children");
+				if (node.op == OP_INVERT && children != 1)
+					return fail("invert takes exactly one child");
+				if (node.op == OP_LEAF && children != 0)
+					return fail("leaves take no children");
+				node.end = static_cast<uint16_t>(program.nodes.size());
+				open.pop_back();
+				done = open.empty();
+				++at;
+				continue;
+			}
+			if (c != '(')
+				return fail(std::string("expected ( but found ") + c);
+			if (open.size() == MAX_DEPTH)
+				return fail("nested deeper than " + std::to_string(MAX_DEPTH));
+			if (program.nodes.size() + 1 >= DONE)
+				return fail("too many nodes");
+			++at;
+			skipSpace();
+			size_t start = at;
+			while (at < text.size() && (std::isalnum(static_cast<unsigned char>(text[at])) || text[at] == '_'))
+				++at;
+			std::string name = text.substr(start, at - start);
+
+			Node node = { OP_LEAF, 0, 0, 0.0f };
+			if (name == "sequence")
+				node.op = OP_SEQUENCE;
+			else if (name == "selector")
+				node.op = OP_SELECTOR;
+			else if (name == "invert")
+				node.op = OP_INVERT;
+			else {
+				size_t leaf = 0;
+				while (leaf < leafNames.size() && leafNames[leaf] != name)
+					++leaf;
+				if (leaf == leafNames.size())
+					return fail("unknown node [" + name + "]");
+				node.leaf = static_cast<uint8_t>(leaf);
+				skipSpace();
+				if (at < text.size() && (std::isdigit(static_cast<unsigned char>(text[at])) || text[at] == '-' || text[at] == '.')) {
+					char* parsed;
+					node.arg = std::strtof(text.c_str() + at, &parsed);
+					at = parsed - text.c_str();
+				}
+			}
+			open.push_back(program.nodes.size());
+			program.nodes.push_back(node);
+		}
+		if (!open.empty())
+			return fail("missing )");
+		if (program.nodes.empty())
+			return fail("empty tree");
+
+		// Leaves keep their order, a subtree starts at its first leaf
+		std::vector<uint16_t> leafOf(program.nodes.size(), NO_NODE);
+		for (size_t i = 0; i < program.nodes.size(); ++i) {
+			const Node& node = program.nodes[i];
+			if (node.op == OP_LEAF) {
+				leafOf[i] = static_cast<uint16_t>(program.code.size());
+				program.code.push_back(Instruction{ node.leaf, { NO_NODE, NO_NODE }, node.arg });
+			}
+		}
+		for (size_t i = program.nodes.size(); i-- > 0;) {
+			if (program.nodes[i].op != OP_LEAF)
+				leafOf[i] = leafOf[i + 1];
+		}
+		link(program, leafOf, 0, DONE + SUCCESS, DONE + FAILURE);
+		return true;
+	}
+
+	inline bool compileFile(const std::string& path, const std::vector<std::string>& leafNames, Program& program, std::string& error) {
+		std::ifstream file(path);
+		if (!file) {
+			error = "can't open " + path;
+			return false;
+		}
+		std::stringstream text;
+		text << file.rdbuf();
+		return compile(text.str(), leafNames, program, error);
+	}
+
+	// Runs the tree once for one agent | leaves(leaf, arg, agent, timer) evaluates a leaf and may count its timer up
+	// The timer starts at 0 and carries over to the next run only while the same leaf keeps returning RUNNING
+	template<typename Leaves>
+	status run(const Program& program, AgentState& state, size_t agent, Leaves& leaves) {
+		const Instruction* code = program.code.data();
+		uint16_t pc = 0;
+		while (pc < DONE) {
+			const Instruction& instruction = code[pc];
+			float timer = state.running == pc ? state.timer : 0.0f;
+			status result = leaves(instruction.leaf, instruction.arg, agent, timer);
+			if (result == RUNNING) {
+				state.running = pc;
+				state.timer = timer;
+				return RUNNING;
+			}
+			pc = instruction.next[result];
+		}
+		state.running = NO_NODE;
+		state.timer = 0.0f;
+		return static_cast<status>(pc - DONE);
+	}
+
+	// Runs the tree for agents [begin, end) | Every state in the range has to name this tree
+	template<typename Leaves>
+	void runBatch(const Program& program, AgentState* states, size_t begin, size_t end, Leaves& leaves) {
+		for (size_t agent = begin; agent < end; ++agent)
+			run(program, states[agent], agent, leaves);
+	}
+}
\ No newline at end of file
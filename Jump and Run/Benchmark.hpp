@@ -0,0 +1,1271 @@
+#pragma once
+#include <random>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <own/helper.hpp>
+#include "Physics.hpp"
+#include "Enemies.hpp"
+#include "Query.hpp"
+#include "Snapshot.hpp"
+#include "Env.hpp"
+#include "Particles.hpp"
+#include "GpuParticles.hpp"
+#include "Replay.hpp"
+
+
+// Headless measurements | Started with --bench <name>, no window or GL context is created except for gpuparticles, which opens a hidden one
+namespace benchmark {
+
+	const size_t BODY_COUNT = 5000;
+	const int TICKS = 120;
+	const float TICK_TIME = 1.0f / physics::DEFAULT_TICK_RATE;
+
+	inline float msSince(util::chrono::point start) {
+		return util::chrono::deltaTime(start, util::chrono::now()) * 1000;
+	}
+
+	// Scatters small bodies over a 256x256 area, either uniformly or packed into a few crowds
+	inline void fillWorld(physics::World& world, size_t count, bool clustered, std::mt19937& rng) {
+		std::uniform_real_distribution<float> area(0.0f, 256.0f);
+		std::uniform_real_distribution<float> speed(-2.0f, 2.0f);
+		std::normal_distribution<float> crowd(0.0f, 4.0f);
+
+		glm::vec2 centers[8];
+		for (auto& c : centers)
+			c = glm::vec2(area(rng), area(rng));
+
+		world.reserve(count);
+		for (size_t i = 0; i < count; ++i) {
+			glm::vec2 pos = clustered ? centers[i % 8] + glm::vec2(crowd(rng), crowd(rng)) : glm::vec2(area(rng), area(rng));
+			world.addBody(pos, glm::vec2(0.4f, 0.4f), glm::vec2(speed(rng), speed(rng)));
+		}
+	}
+
+	inline void broadphaseRun(std::string name, std::unique_ptr<physics::Broadphase> broadphase, bool clustered) {
+		gameMap::Map map(nullptr, nullptr, nullptr);
+		physics::World world(&map, std::move(broadphase));
+		world.gravity = glm::vec2(0);
+		std::mt19937 rng(1234);
+		fillWorld(world, BODY_COUNT, clustered, rng);
+
+		float updateTime = 0;
+		size_t candidates = 0, pairs = 0;
+		for (int t = 0; t < TICKS; ++t) {
+			world.integrate(TICK_TIME);
+			world.collideTiles(TICK_TIME);
+
+			util::chrono::point start = util::chrono::now();
+			world.findPairs();
+			updateTime += msSince(start);
+			candidates += world.getBroadphase().candidates;
+			pairs += world.pairs.size();
+		}
+
+		console::printInfo(std::string(clustered ? "clustered " : "uniform   ") + name
+			+ " | bodies " + std::to_string(BODY_COUNT)
+			+ " | candidates/tick " + std::to_string(candidates / TICKS)
+			+ " | pairs/tick " + std::to_string(pairs / TICKS)
+			+ " | update " + std::to_string(updateTime / TICKS) + " ms");
+	}
+
+	inline void broadphase() {
+		for (int clustered = 0; clustered < 2; ++clustered) {
+			broadphaseRun("SpatialHash", std::unique_ptr<physics::Broadphase>(new physics::SpatialHash()), clustered != 0);
+			broadphaseRun("AabbTree   ", std::unique_ptr<physics::Broadphase>(new physics::AabbTree()), clustered != 0);
+		}
+	}
+
+	// Lays a floor of solid blocks over [0, width)
+	inline void buildFloor(gameMap::Map& map, gameMap::BlockHandle block, unsigned int width) {
+		for (unsigned int x = 0; x < width; ++x)
+			map.addBlock(glm::uvec2(x, 0), block);
+	}
+
+	// Drops crates onto a floor and reports how the tick cost follows the awake bodies as they settle
+	inline void sleep() {
+		gameMap::Map map(nullptr, nullptr, nullptr);
+		gameMap::BlockHandle block = map.addBlockType();
+		buildFloor(map, block, 256);
+
+		physics::World world(&map);
+		world.reserve(BODY_COUNT);
+		for (size_t i = 0; i < BODY_COUNT; ++i)
+			world.addBody(glm::vec2(1.0f + (i % 250), 1.5f + (i / 250) * 1.2f), glm::vec2(0.4f, 0.4f));
+
+		for (int second = 0; second < 10; ++second) {
+			util::chrono::point start = util::chrono::now();
+			for (int t = 0; t < 60; ++t)
+				world.step(TICK_TIME);
+			console::printInfo("sleep | second " + std::to_string(second + 1)
+				+ " | awake " + std::to_string(world.awake()) + "/" + std::to_string(world.size())
+				+ " | tick " + std::to_string(msSince(start) / 60) + " ms");
+		}
+	}
+
+	// Steps the same settling pile with 1 to N threads | Reports the scaling and returns whether every run ended bit identical
+	inline bool threads() {
+		gameMap::Map map(nullptr, nullptr, nullptr);
+		gameMap::BlockHandle block = map.addBlockType();
+		buildFloor(map, block, 256);
+
+		unsigned int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+		float singleThreaded = 0;
+		uint64_t expectedHash = 0;
+		bool deterministic = true;
+		for (unsigned int count = 1; count <= maxThreads; ++count) {
+			jobs::WorkerPool pool(count);
+			physics::World world(&map);
+			world.setWorkerPool(&pool);
+			world.reserve(BODY_COUNT);
+			for (size_t i = 0; i < BODY_COUNT; ++i)
+				world.addBody(glm::vec2(1.0f + (i % 250), 1.5f + (i / 250) * 1.2f), glm::vec2(0.4f, 0.4f));
+
+			util::chrono::point start = util::chrono::now();
+			for (int t = 0; t < TICKS; ++t)
+				world.step(TICK_TIME);
+			float tickTime = msSince(start) / TICKS;
+
+			if (count == 1) {
+				singleThreaded = tickTime;
+				expectedHash = world.stateHash();
+			}
+			deterministic = deterministic && world.stateHash() == expectedHash;
+			console::printInfo("threads " + std::to_string(count)
+				+ " | tick " + std::to_string(tickTime) + " ms"
+				+ " | speedup " + std::to_string(singleThreaded / tickTime)
+				+ (world.stateHash() == expectedHash ? " | deterministic" : " | STATE DIFFERS"));
+		}
+		return deterministic;
+	}
+
+	// Crates of 1x1 resting on each other from the first tick | A single column or a pyramid with an 8 crate base
+	inline void buildStack(physics::World& world, bool pile) {
+		if (!pile) {
+			for (int i = 0; i < 12; ++i)
+				world.addBody(glm::vec2(8.5f, 1.5f + i), glm::vec2(0.5f, 0.5f));
+			return;
+		}
+		for (int row = 0; row < 8; ++row) {
+			for (int i = 0; i < 8 - row; ++i)
+				world.addBody(glm::vec2(4.5f + row * 0.5f + i, 1.5f + row), glm::vec2(0.5f, 0.5f));
+		}
+	}
+
+	// Settles a stack and a pile with 1 to 16 solver iterations, cold and warm started
+	// Stable means the whole scene fell asleep within 10 seconds with the top crate sunk by less than MAX_SAG
+	inline void stacking() {
+		const int MAX_TICKS = 600;
+		const float MAX_SAG = 0.1f;
+		for (int pile = 0; pile < 2; ++pile) {
+			for (int warm = 0; warm < 2; ++warm) {
+				int needed = 0;
+				for (int iterations = 1; iterations <= 16; iterations *= 2) {
+					gameMap::Map map(nullptr, nullptr, nullptr);
+					gameMap::BlockHandle block = map.addBlockType();
+					buildFloor(map, block, 16);
+					physics::World world(&map);
+					world.solverIterations = iterations;
+					world.warmStarting = warm != 0;
+					buildStack(world, pile != 0);
+					physics::BodyHandle top = world.size() - 1;
+					float startY = world.getPos(top).y;
+
+					int ticks = 0;
+					while (ticks < MAX_TICKS && world.awake() > 0) {
+						world.step(TICK_TIME);
+						++ticks;
+					}
+					bool asleep = world.awake() == 0;
+					float sag = startY - world.getPos(top).y;
+					if (asleep && sag < MAX_SAG && needed == 0)
+						needed = iterations;
+
+					console::printInfo(std::string(pile ? "pile " : "stack") + (warm ? " | warm" : " | cold")
+						+ " | iterations " + std::to_string(iterations)
+						+ (asleep ? " | asleep after " + std::to_string(ticks) + " ticks" : " | still awake")
+						+ " | sag " + std::to_string(sag));
+				}
+				console::printInfo(std::string(pile ? "pile " : "stack") + (warm ? " | warm" : " | cold")
+					+ (needed ? " | stable from " + std::to_string(needed) + " iterations" : " | never stable"));
+			}
+		}
+	}
+
+	// Slides crates along a 1024 wide floor with the view at its left end, once without and once with level of detail
+	// Reports how the tick cost follows the bodies near the view
+	inline void detail() {
+		const size_t COUNT = 20000;
+		gameMap::Map map(nullptr, nullptr, nullptr);
+		gameMap::BlockHandle block = map.addBlockType();
+		buildFloor(map, block, 1024);
+
+		for (int lod = 0; lod < 2; ++lod) {
+			physics::World world(&map);
+			if (lod)
+				world.setView(physics::VIEW_MIN, physics::VIEW_MAX);
+			std::mt19937 rng(1234);
+			std::uniform_real_distribution<float> speed(-4.0f, 4.0f);
+			world.reserve(COUNT);
+			for (size_t i = 0; i < COUNT; ++i)
+				world.addBody(glm::vec2(1.0f + (i % 1000), 1.5f + (i / 1000) * 1.2f), glm::vec2(0.4f, 0.4f), glm::vec2(speed(rng), 0));
+
+			for (int second = 0; second < 5; ++second) {
+				util::chrono::point start = util::chrono::now();
+				for (int t = 0; t < 60; ++t)
+					world.step(TICK_TIME);
+				console::printInfo(std::string(lod ? "detail on  " : "detail off ") + "| second " + std::to_string(second + 1)
+					+ " | full " + std::to_string(world.fullRate())
+					+ " | reduced " + std::to_string(world.awake() - world.fullRate())
+					+ " | frozen " + std::to_string(world.frozen())
+					+ " | asleep " + std::to_string(world.size() - world.awake() - world.frozen())
+					+ " | tick " + std::to_string(msSince(start) / 60) + " ms");
+			}
+		}
+	}
+
+	// Saves every tick of a game with BODY_COUNT crates and rolls back ROLLBACK ticks twice a second
+	// Every re-simulated tick has to hash the same as the first time, with a map edit inside the rolled back span | Returns whether they did
+	inline bool snapshot() {
+		const int ROLLBACK = 8;
+		gameMap::Map map(nullptr, nullptr, nullptr);
+		gameMap::BlockHandle block = map.addBlockType();
+		buildFloor(map, block, 256);
+
+		ecs::Registry registry;
+		physics::PhysicsHandler physics(&registry, &map, glm::vec2(3, 6));
+		physics::World& world = physics.getWorld();
+		world.reserve(BODY_COUNT + 1);
+		for (size_t i = 0; i < BODY_COUNT; ++i)
+			world.addBody(glm::vec2(1.0f + (i % 250), 1.5f + (i / 250) * 1.2f), glm::vec2(0.4f, 0.4f));
+
+		physics::SnapshotRing ring(&physics, &map, 2 * ROLLBACK);
+		std::vector<uint64_t> hashes;
+		float saveTime = 0, restoreTime = 0;
+		int saves = 0, restores = 0;
+		bool deterministic = true;
+
+		// Input and map edits follow the tick, so a re-simulation replays them
+		auto tick = [&](int t) {
+			if (t % 40 == 20)
+				map.addBlock(glm::uvec2(t % 256, 1 + t / 40), block);
+			physics.updatePhysics(static_cast<physics::movementX>((t / 50) % 3 - 1), TICK_TIME);
+			util::chrono::point start = util::chrono::now();
+			ring.save(t);
+			saveTime += msSince(start);
+			++saves;
+		};
+
+		for (int t = 0; t < TICKS * 2; ++t) {
+			tick(t);
+			hashes.push_back(world.stateHash());
+			if (t % 30 != 29)
+				continue;
+
+			util::chrono::point start = util::chrono::now();
+			ring.restore(t - ROLLBACK);
+			restoreTime += msSince(start);
+			++restores;
+			for (int r = t - ROLLBACK + 1; r <= t; ++r) {
+				tick(r);
+				deterministic = deterministic && world.stateHash() == hashes[r];
+			}
+		}
+
+		console::printInfo("snapshot | bodies " + std::to_string(world.size())
+			+ " | frame " + std::to_string(ring.frameBytes() / 1024) + " KiB"
+			+ " | save " + std::to_string(saveTime * 1000 / saves) + " us"
+			+ " | restore " + std::to_string(restoreTime * 1000 / restores) + " us"
+			+ (deterministic ? " | rollbacks match" : " | ROLLBACK DIFFERS"));
+		return deterministic;
+	}
+
+	// Hangs ROPES ropes of SEGMENTS pieces from a ceiling, every fourth one a bridge, and swings a crate on the first
+	// Reports the rope tick, how far the worst link is stretched and how far the crate swung
+	inline void ropes() {
+		const int ROPES = 256;
+		const int SEGMENTS = 32;
+		gameMap::Map map(nullptr, nullptr, nullptr);
+		gameMap::BlockHandle block = map.addBlockType();
+		buildFloor(map, block, 1040);
+
+		physics::World world(&map);
+		physics::RopeSystem ropes(&map);
+		for (int r = 0; r < ROPES; ++r) {
+			glm::vec2 start(2.0f + r * 4, 12.0f);
+			if (r % 4 == 3)
+				ropes.addRope(start, start + glm::vec2(3.5f, 0), SEGMENTS, true, true);
+			else
+				ropes.addRope(start, start + glm::vec2(3.0f, -4.0f) * (1.0f + r % 3), SEGMENTS, true);
+		}
+		physics::BodyHandle crate = world.addBody(ropes.getPos(ropes.particle(0, SEGMENTS)), glm::vec2(0.5f, 0.5f));
+		ropes.attach(crate, ropes.particle(0, SEGMENTS));
+
+		float ropeTime = 0, swingMin = world.getPos(crate).x, swingMax = swingMin;
+		for (int t = 0; t < TICKS * 2; ++t) {
+			world.step(TICK_TIME);
+			util::chrono::point start = util::chrono::now();
+			ropes.step(world, TICK_TIME);
+			ropeTime += msSince(start);
+			swingMin = std::min(swingMin, world.getPos(crate).x);
+			swingMax = std::max(swingMax, world.getPos(crate).x);
+		}
+
+		float stretch = 0;
+		for (uint32_t r = 0; r < ropes.ropeCount(); ++r) {
+			float rest = (r % 4 == 3 ? 3.5f : 5.0f * (1.0f + r % 3)) / SEGMENTS;
+			for (uint32_t k = 0; k < SEGMENTS; ++k) {
+				float length = glm::length(ropes.getPos(ropes.particle(r, k + 1)) - ropes.getPos(ropes.particle(r, k)));
+				stretch = std::max(stretch, length / rest - 1.0f);
+			}
+		}
+
+		console::printInfo("ropes | " + std::to_string(ROPES) + " x " + std::to_string(SEGMENTS) + " segments"
+			+ " | particles " + std::to_string(ropes.particleCount())
+			+ " | iterations " + std::to_string(ropes.iterations)
+			+ " | tick " + std::to_string(ropeTime / (TICKS * 2)) + " ms"
+			+ " | worst stretch " + std::to_string(stretch * 100) + "%"
+			+ " | swing " + std::to_string(swingMax - swingMin));
+	}
+
+	// Swings a big crate on a rope into a wall left of the pivot | Returns whether the crate stayed out of the wall on every tick
+	inline bool ropeWall() {
+		const float WALL = 8.0f;
+		gameMap::Map map(nullptr, nullptr, nullptr);
+		gameMap::BlockHandle block = map.addBlockType();
+		buildFloor(map, block, 64);
+		for (unsigned int y = 1; y < 12; ++y)
+			map.addBlock(glm::uvec2(static_cast<unsigned int>(WALL) - 1, y), block);
+
+		physics::World world(&map);
+		physics::RopeSystem ropes(&map);
+		uint32_t rope = ropes.addRope(glm::vec2(10.0f, 12.0f), glm::vec2(15.0f, 12.0f), 10, true);
+		glm::vec2 half(0.8f, 0.8f);
+		physics::BodyHandle crate = world.addBody(ropes.getPos(ropes.particle(rope, 10)), half);
+		ropes.attach(crate, ropes.particle(rope, 10));
+
+		int inside = 0;
+		float closest = world.getPos(crate).x;
+		for (int t = 0; t < TICKS * 10; ++t) {
+			world.step(TICK_TIME);
+			ropes.step(world, TICK_TIME);
+			glm::vec2 pos = world.getPos(crate);
+			closest = std::min(closest, pos.x - half.x);
+			inside += pos.x - half.x < WALL - 1e-3f;
+		}
+		console::printInfo("ropewall | closest " + std::to_string(closest) + " to the wall at " + std::to_string(WALL)
+			+ " | ticks inside " + std::to_string(inside) + " | " + (inside == 0 ? "ok" : "FAILED"));
+		return inside == 0;
+	}
+
+	// Drops BODY_COUNT crates onto a floor and prints the rolling step stats every half second, serial and on the worker pool
+	// The counters have to match between the two
+	inline void stats() {
+		gameMap::Map map(nullptr, nullptr, nullptr);
+		gameMap::BlockHandle block = map.addBlockType();
+		buildFloor(map, block, 256);
+
+		jobs::WorkerPool pool;
+		for (int threaded = 0; threaded < 2; ++threaded) {
+			physics::World world(&map);
+			if (threaded)
+				world.setWorkerPool(&pool);
+			world.reserve(BODY_COUNT);
+			for (size_t i = 0; i < BODY_COUNT; ++i)
+				world.addBody(glm::vec2(1.0f + (i % 250), 1.5f + (i / 250) * 1.2f), glm::vec2(0.4f, 0.4f));
+
+			physics::StatsAverage average(30);
+			for (int t = 1; t <= TICKS; ++t) {
+				world.step(TICK_TIME);
+				average.add(world.stats);
+				if (t % 30 == 0)
+					console::printInfo("stats | threads " + std::to_string(threaded ? pool.threadCount() : 1) + " | " + physics::describe(average.average()));
+			}
+		}
+	}
+
+	// Steps ENV_COUNT headless players on the demo level with random input, serial and on the worker pool
+	// Also follows the replay input with one instance and a PhysicsHandler and reports how far they drift apart
+	inline void environments() {
+		const size_t ENV_COUNT = 4096;
+		const int ENV_TICKS = 600;
+		gameMap::Map map(nullptr, nullptr, nullptr);
+		gameMap::BlockHandle block = map.addBlockType();
+		gameMap::buildDemoLevel(map, block);
+		glm::vec2 spawn(3, 6);
+
+		std::mt19937 rng(1234);
+		std::uniform_int_distribution<int> input(-1, 1);
+		std::vector<physics::movementX> actions(ENV_COUNT * 8);
+		for (physics::movementX& a : actions)
+			a = static_cast<physics::movementX>(input(rng));
+		std::vector<env::Observation> observations(ENV_COUNT);
+
+		jobs::WorkerPool pool;
+		for (int threaded = 0; threaded < 2; ++threaded) {
+			env::VectorEnv envs(&map, ENV_COUNT, spawn, threaded ? &pool : nullptr);
+			size_t resets = 0;
+			util::chrono::point start = util::chrono::now();
+			for (int t = 0; t < ENV_TICKS; ++t) {
+				envs.step(&actions[((t / 20) % 8) * ENV_COUNT], observations.data());
+				for (const env::Observation& o : observations)
+					resets += o.reset;
+			}
+			float seconds = msSince(start) / 1000;
+			console::printInfo(std::string("environments | threads ") + std::to_string(threaded ? pool.threadCount() : 1)
+				+ " | instances " + std::to_string(ENV_COUNT)
+				+ " | " + std::to_string(ENV_COUNT * ENV_TICKS / seconds / 1e6f) + " M steps/s"
+				+ " | resets " + std::to_string(resets));
+		}
+
+		ecs::Registry registry;
+		physics::PhysicsHandler physics(&registry, &map, spawn);
+		env::VectorEnv single(&map, 1, spawn);
+		env::Observation observation;
+		float drift = 0;
+		for (int t = 0; t < ENV_TICKS; ++t) {
+			physics::movementX movX = static_cast<physics::movementX>((t / 50) % 3 - 1);
+			physics.updatePhysics(movX, TICK_TIME);
+			single.step(&movX, &observation);
+			drift = std::max(drift, glm::length(observation.pos - physics.getPlayerPos()));
+		}
+		console::printInfo("environments | largest distance to PhysicsHandler over " + std::to_string(ENV_TICKS) + " ticks " + std::to_string(drift));
+	}
+
+	// Keeps PROJECTILE_COUNT projectiles flying over a pile of BODY_COUNT crates, topping the pool up every tick
+	// Serial and on the worker pool | The events have to match between the two
+	inline void projectiles() {
+		const size_t PROJECTILE_COUNT = 10000;
+		gameMap::Map map(nullptr, nullptr, nullptr);
+		gameMap::BlockHandle block = map.addBlockType();
+		buildFloor(map, block, 256);
+
+		jobs::WorkerPool pool;
+		uint64_t hashes[2] = {};
+		for (int threaded = 0; threaded < 2; ++threaded) {
+			physics::World world(&map);
+			world.reserve(BODY_COUNT);
+			for (size_t i = 0; i < BODY_COUNT; ++i)
+				world.addBody(glm::vec2(1.0f + (i % 250), 1.5f + (i / 250) * 1.2f), glm::vec2(0.4f, 0.4f));
+			physics::ProjectileSystem projectiles(world, PROJECTILE_COUNT, PROJECTILE_COUNT, threaded ? &pool : nullptr);
+			projectiles.gravity = glm::vec2(0, -9.0f);
+
+			std::mt19937 rng(1234);
+			std::uniform_real_distribution<float> x(0.0f, 256.0f), y(2.0f, 40.0f), speed(-30.0f, 30.0f), lifetime(0.5f, 3.0f);
+			float stepTime = 0;
+			size_t hits = 0, expired = 0;
+			for (int t = 0; t < TICKS; ++t) {
+				while (projectiles.size() < PROJECTILE_COUNT)
+					projectiles.spawn(glm::vec2(x(rng), y(rng)), glm::vec2(speed(rng), speed(rng)), lifetime(rng));
+				world.step(TICK_TIME);
+
+				util::chrono::point start = util::chrono::now();
+				projectiles.step(TICK_TIME);
+				stepTime += msSince(start);
+				for (const physics::ProjectileEvent& e : projectiles.getEvents()) {
+					hits += e.type != physics::PROJECTILE_EXPIRED;
+					expired += e.type == physics::PROJECTILE_EXPIRED;
+					hashes[threaded] = hashes[threaded] * 31 + e.projectile + e.body;
+				}
+			}
+
+			console::printInfo(std::string("projectiles | threads ") + std::to_string(threaded ? pool.threadCount() : 1)
+				+ " | live " + std::to_string(PROJECTILE_COUNT)
+				+ " | step " + std::to_string(stepTime / TICKS) + " ms"
+				+ " | hits/tick " + std::to_string(hits / TICKS)
+				+ " | expired/tick " + std::to_string(expired / TICKS)
+				+ (threaded && hashes[0] != hashes[1] ? " | EVENTS DIFFER" : ""));
+		}
+	}
+
+	// Runs QUERY_COUNT of each query kind against a settling pile of crates, serial and on the worker pool
+	inline void queries() {
+		const size_t QUERY_COUNT = 1024;
+		const int FRAMES = 60;
+		gameMap::Map map(nullptr, nullptr, nullptr);
+		gameMap::BlockHandle block = map.addBlockType();
+		buildFloor(map, block, 256);
+
+		physics::World world(&map);
+		world.reserve(BODY_COUNT);
+		for (size_t i = 0; i < BODY_COUNT; ++i)
+			world.addBody(glm::vec2(1.0f + (i % 250), 1.5f + (i / 250) * 1.2f), glm::vec2(0.4f, 0.4f));
+
+		std::mt19937 rng(1234);
+		std::uniform_real_distribution<float> x(0.0f, 256.0f), y(0.0f, 32.0f), offset(-2.0f, 2.0f);
+		std::vector<physics::BoxQuery> stand(QUERY_COUNT);
+		std::vector<physics::BoxCast> casts(QUERY_COUNT);
+		std::vector<physics::CircleQuery> circles(QUERY_COUNT);
+		for (size_t i = 0; i < QUERY_COUNT; ++i) {
+			stand[i] = { glm::vec2(x(rng), y(rng)), glm::vec2(0.25f, 0.5f), physics::INVALID_BODY };
+			casts[i] = { glm::vec2(x(rng), y(rng)), glm::vec2(0.5f, 0.25f), glm::vec2(offset(rng), offset(rng)), physics::INVALID_BODY };
+			circles[i] = { glm::vec2(x(rng), y(rng)), 2.0f };
+		}
+
+		std::unique_ptr<bool[]> free(new bool[QUERY_COUNT]);
+		std::vector<physics::CastHit> hits(QUERY_COUNT);
+		std::vector<physics::QueryRange> ranges(QUERY_COUNT);
+		std::vector<physics::BodyHandle> bodies;
+
+		jobs::WorkerPool pool;
+		for (int threaded = 0; threaded < 2; ++threaded) {
+			physics::WorldQuery query(world, threaded ? &pool : nullptr);
+			float standTime = 0, castTime = 0, circleTime = 0;
+			size_t freeCount = 0, hitCount = 0;
+			for (int frame = 0; frame < FRAMES; ++frame) {
+				world.step(TICK_TIME);
+
+				util::chrono::point start = util::chrono::now();
+				query.roomToStand(stand.data(), QUERY_COUNT, free.get());
+				standTime += msSince(start);
+
+				start = util::chrono::now();
+				query.boxCast(casts.data(), QUERY_COUNT, hits.data());
+				castTime += msSince(start);
+
+				start = util::chrono::now();
+				query.circleOverlap(circles.data(), QUERY_COUNT, ranges.data(), bodies);
+				circleTime += msSince(start);
+			}
+			for (size_t i = 0; i < QUERY_COUNT; ++i) {
+				freeCount += free[i];
+				hitCount += hits[i].hit;
+			}
+
+			console::printInfo(std::string("queries | threads ") + std::to_string(threaded ? pool.threadCount() : 1)
+				+ " | " + std::to_string(QUERY_COUNT) + " each"
+				+ " | room to stand " + std::to_string(standTime / FRAMES) + " ms (" + std::to_string(freeCount) + " free)"
+				+ " | box cast " + std::to_string(castTime / FRAMES) + " ms (" + std::to_string(hitCount) + " hit)"
+				+ " | circle " + std::to_string(circleTime / FRAMES) + " ms (" + std::to_string(bodies.size()) + " bodies)");
+		}
+	}
+
+	// Moves ENTITY_COUNT entities spread over four archetypes, through each() and through a lookup per entity
+	// Then runs WALKER_COUNT walking enemies through the PhysicsHandler and a WalkerSystem, which turn at the walls and respawn when they fall off
+	// and finally replaces some of them every tick
+	inline void entities() {
+		const size_t ENTITY_COUNT = 200000;
+		const size_t WALKER_COUNT = 2000;
+		ecs::Registry registry;
+		std::vector<ecs::Entity> created;
+		created.reserve(ENTITY_COUNT);
+		for (size_t i = 0; i < ENTITY_COUNT; ++i) {
+			gameEntity::Motion motion = { glm::vec2(i % 256, i / 256), glm::vec2(i % 256, i / 256), glm::vec2(1, 0) };
+			ecs::Entity e = registry.create(motion, gameEntity::Runner());
+			if (i % 2)
+				registry.add(e, gameEntity::Walker{ 1.0f, 0.0f });
+			if (i % 3 == 0)
+				registry.add(e, gameEntity::Sprite{ 0, 0, glm::vec2(0) });
+			created.push_back(e);
+		}
+		// Lookups in random order, as pointers scattered over the heap would be
+		std::mt19937 rng(1234);
+		std::shuffle(created.begin(), created.end(), rng);
+
+		util::chrono::point start = util::chrono::now();
+		for (int t = 0; t < TICKS; ++t) {
+			registry.each<gameEntity::Motion, gameEntity::Runner>([](ecs::Entity, gameEntity::Motion& motion, gameEntity::Runner& runner) {
+				motion.prevPos = motion.pos;
+				motion.pos += motion.velocity * runner.runSpeed * TICK_TIME;
+			});
+		}
+		float linear = msSince(start) / TICKS;
+
+		start = util::chrono::now();
+		for (int t = 0; t < TICKS; ++t) {
+			for (ecs::Entity e : created) {
+				gameEntity::Motion* motion = registry.get<gameEntity::Motion>(e);
+				motion->prevPos = motion->pos;
+				motion->pos += motion->velocity * registry.get<gameEntity::Runner>(e)->runSpeed * TICK_TIME;
+			}
+		}
+		float lookup = msSince(start) / TICKS;
+		console::printInfo("entities | " + std::to_string(ENTITY_COUNT) + " in 4 archetypes | each " + std::to_string(linear)
+			+ " ms | lookup per entity " + std::to_string(lookup) + " ms");
+
+		gameMap::Map map(nullptr, nullptr, nullptr);
+		gameMap::BlockHandle block = map.addBlockType();
+		buildFloor(map, block, 256);
+		for (unsigned int y = 1; y < 4; ++y)
+			map.addBlock(glm::uvec2(128, y), block);
+		ecs::Registry game;
+		physics::PhysicsHandler physics(&game, &map, glm::vec2(3, 6));
+		enemies::WalkerSystem walkerAI(&game, &physics);
+		physics.getWorld().reserve(WALKER_COUNT + 1);
+		for (size_t i = 0; i < WALKER_COUNT; ++i)
+			walkerAI.spawn(glm::vec2(1.0f + (i % 250), 1.0f + (i / 250) * 2.2f), i % 2 ? 1.0f : -1.0f, gameEntity::Runner{ glm::vec2(0.4f, 0.4f), 4.0f });
+
+		start = util::chrono::now();
+		for (int t = 0; t < TICKS * 4; ++t) {
+			physics.updatePhysics(physics::STILLX, TICK_TIME);
+			walkerAI.update(TICK_TIME);
+		}
+		float tick = msSince(start) / (TICKS * 4);
+		size_t away = 0;
+		game.each<gameEntity::Walker, gameEntity::Motion>([&](ecs::Entity, gameEntity::Walker& walker, gameEntity::Motion& motion) {
+			away += (motion.pos.x < 128) == (walker.direction < 0);
+		});
+		console::printInfo("entities | walkers " + std::to_string(game.count<gameEntity::Walker>()) + " | tick " + std::to_string(tick)
+			+ " ms | walking away from the wall " + std::to_string(away));
+
+		// Despawns the oldest CHURN walkers and spawns as many new ones every tick
+		const size_t CHURN = 100;
+		std::vector<ecs::Entity> walkers;
+		game.each<gameEntity::Walker>([&](ecs::Entity e, gameEntity::Walker&) {
+			walkers.push_back(e);
+		});
+		game.reserve<gameEntity::Motion, gameEntity::Runner, gameEntity::PhysicsBody, gameEntity::Respawn, gameEntity::Walker>(WALKER_COUNT + CHURN);
+		size_t oldest = 0, stale = 0;
+		start = util::chrono::now();
+		for (int t = 0; t < TICKS; ++t) {
+			for (size_t k = 0; k < CHURN; ++k, oldest = (oldest + 1) % walkers.size()) {
+				ecs::Entity gone = walkers[oldest];
+				physics.despawn(gone);
+				walkers[oldest] = walkerAI.spawn(glm::vec2(1.0f + oldest % 250, 12.0f), 1.0f, gameEntity::Runner{ glm::vec2(0.4f, 0.4f), 4.0f });
+				stale += game.alive(gone);
+			}
+			physics.updatePhysics(physics::STILLX, TICK_TIME);
+			walkerAI.update(TICK_TIME);
+		}
+		console::printInfo("entities | churn " + std::to_string(CHURN * TICKS) + " spawns and despawns | tick " + std::to_string(msSince(start) / TICKS)
+			+ " ms | walkers " + std::to_string(game.count<gameEntity::Walker>()) + " | stale handles alive " + std::to_string(stale));
+	}
+
+	// One frame of independent systems, run one after another and through a FrameGraph on the worker pool
+	// Bodies, bots, ropes and entities share nothing, so the graph runs them side by side | Returns whether the results matched
+	inline bool frameGraph() {
+		const int FRAMES = 120;
+		gameMap::Map map(nullptr, nullptr, nullptr);
+		gameMap::BlockHandle block = map.addBlockType();
+		buildFloor(map, block, 1040);
+
+		jobs::WorkerPool serial(1), pool;
+		uint64_t hashes[2] = {};
+		for (int threaded = 0; threaded < 2; ++threaded) {
+			jobs::WorkerPool& workers = threaded ? pool : serial;
+			physics::World world(&map);
+			world.setWorkerPool(&workers);
+			std::mt19937 rng(1234);
+			fillWorld(world, BODY_COUNT, false, rng);
+
+			env::VectorEnv bots(&map, 4096, glm::vec2(3, 6), &workers);
+			std::vector<physics::movementX> actions(bots.size());
+			std::vector<env::Observation> observations(bots.size());
+
+			physics::World ropeWorld(&map);
+			physics::RopeSystem ropes(&map);
+			for (int r = 0; r < 64; ++r)
+				ropes.addRope(glm::vec2(2.0f + r * 4, 12.0f), glm::vec2(5.0f + r * 4, 8.0f), 32, true);
+
+			ecs::Registry registry;
+			for (size_t i = 0; i < 100000; ++i)
+				registry.create(gameEntity::Motion{ glm::vec2(i % 256, i / 256), glm::vec2(0), glm::vec2(1, 0) });
+
+			uint64_t botHash = 0;
+			jobs::FrameGraph frame;
+			frame.add("bodies", {}, { "world" }, [&] {
+				world.step(TICK_TIME);
+			});
+			frame.add("bots", {}, { "bots" }, [&] {
+				for (size_t i = 0; i < actions.size(); ++i)
+					actions[i] = static_cast<physics::movementX>(static_cast<int>((i * 7 + botHash) % 3) - 1);
+				bots.step(actions.data(), observations.data());
+				for (const env::Observation& o : observations)
+					botHash = botHash * 31 + static_cast<uint64_t>(o.pos.x * 1024);
+			});
+			frame.add("ropes", {}, { "ropes" }, [&] {
+				ropes.step(ropeWorld, TICK_TIME);
+			});
+			frame.add("entities", {}, { "entities" }, [&] {
+				registry.each<gameEntity::Motion>([](ecs::Entity, gameEntity::Motion& motion) {
+					motion.prevPos = motion.pos;
+					motion.pos += motion.velocity * TICK_TIME;
+				});
+			});
+
+			workers.takeStats();
+			util::chrono::point start = util::chrono::now();
+			for (int f = 0; f < FRAMES; ++f)
+				frame.run(workers);
+			float total = msSince(start);
+
+			std::string line = "jobs | threads " + std::to_string(workers.threadCount()) + " | frame " + std::to_string(total / FRAMES) + " ms |";
+			for (size_t s = 0; s < frame.size(); ++s)
+				line += " " + frame.name(s) + " " + std::to_string(frame.lastMs(s));
+			line += " | utilization";
+			for (const jobs::WorkerStats& worker : workers.takeStats())
+				line += " " + std::to_string(static_cast<int>(worker.busyMs * 100 / total)) + "% (" + std::to_string(worker.steals) + " steals)";
+			console::printInfo(line);
+			hashes[threaded] = world.stateHash() ^ botHash ^ static_cast<uint64_t>(ropes.getPos(ropes.particle(0, 32)).y * 1e6f);
+		}
+		console::printInfo(std::string("jobs | serial and graph ") + (hashes[0] == hashes[1] ? "match" : "DIFFER"));
+		return hashes[0] == hashes[1];
+	}
+
+	// AGENT_COUNT walkers spread along a long corridor, thinking through the scheduler and then all of them every tick
+	// Reports AI time per tick against its budget and how long the far ones had to wait
+	inline void agents() {
+		const size_t AGENT_COUNT = 10000;
+		const int AI_TICKS = 240;
+		gameMap::Map map(nullptr, nullptr, nullptr);
+		gameMap::BlockHandle block = map.addBlockType();
+		buildFloor(map, block, 1040);
+		for (unsigned int x = 0; x < 1040; x += 64) {
+			for (unsigned int y = 1; y < 4; ++y)
+				map.addBlock(glm::uvec2(x, y), block);
+		}
+
+		for (int scheduled = 1; scheduled >= 0; --scheduled) {
+			ecs::Registry registry;
+			physics::PhysicsHandler physics(&registry, &map, glm::vec2(3, 6));
+			enemies::WalkerSystem walkerAI(&registry, &physics);
+			ai::Scheduler& brains = walkerAI.getBrains();
+			if (!scheduled) {
+				brains.midInterval = 1;
+				brains.farInterval = 1;
+				brains.budgetMs = 0;
+			}
+			physics.getWorld().reserve(AGENT_COUNT + 1);
+			for (size_t i = 0; i < AGENT_COUNT; ++i)
+				walkerAI.spawn(glm::vec2(2.0f + (i % 1000) * 1.03f, 1.5f + (i / 1000) * 2.5f), i % 2 ? 1.0f : -1.0f, gameEntity::Runner{ glm::vec2(0.4f, 0.4f), 4.0f });
+
+			float total = 0, worst = 0;
+			uint32_t thoughts = 0, due = 0;
+			uint16_t mostWaited = 0;
+			for (int t = 0; t < AI_TICKS; ++t) {
+				physics.updatePhysics(physics::STILLX, TICK_TIME);
+				walkerAI.update(TICK_TIME);
+				const ai::SchedulerStats& stats = brains.stats;
+				total += stats.ms;
+				worst = std::max(worst, stats.ms);
+				thoughts += stats.thought;
+				due += stats.due;
+				mostWaited = std::max(mostWaited, stats.mostWaited);
+			}
+			const ai::SchedulerStats& last = brains.stats;
+			console::printInfo(std::string("ai | ") + (scheduled ? "scheduled" : "every tick") + " | agents " + std::to_string(last.agents)
+				+ " (near " + std::to_string(last.near) + " mid " + std::to_string(last.mid) + " far " + std::to_string(last.far) + ")"
+				+ " | ai " + std::to_string(total / AI_TICKS) + " ms avg " + std::to_string(worst) + " ms worst, budget " + std::to_string(brains.budgetMs)
+				+ " | thoughts/tick " + std::to_string(thoughts / AI_TICKS) + " of " + std::to_string(due / AI_TICKS) + " due | longest wait " + std::to_string(mostWaited) + " ticks");
+		}
+	}
+
+	// Classic behavior tree of heap nodes with virtual tick calls | Baseline for the compiled trees of behaviors()
+	struct TreeNode {
+		std::vector<std::unique_ptr<TreeNode>> children;
+		virtual ~TreeNode() {}
+		virtual behavior::status tick(size_t agent, enemies::WalkerBatch& batch, float& timer) = 0;
+	};
+
+	struct SequenceNode : TreeNode {
+		behavior::status tick(size_t agent, enemies::WalkerBatch& batch, float& timer) override {
+			for (auto& child : children) {
+				behavior::status result = child->tick(agent, batch, timer);
+				if (result != behavior::SUCCESS)
+					return result;
+			}
+			return behavior::SUCCESS;
+		}
+	};
+
+	struct SelectorNode : TreeNode {
+		behavior::status tick(size_t agent, enemies::WalkerBatch& batch, float& timer) override {
+			for (auto& child : children) {
+				behavior::status result = child->tick(agent, batch, timer);
+				if (result != behavior::FAILURE)
+					return result;
+			}
+			return behavior::FAILURE;
+		}
+	};
+
+	struct InvertNode : TreeNode {
+		behavior::status tick(size_t agent, enemies::WalkerBatch& batch, float& timer) override {
+			behavior::status result = children[0]->tick(agent, batch, timer);
+			return result == behavior::RUNNING ? result : result == behavior::SUCCESS ? behavior::FAILURE : behavior::SUCCESS;
+		}
+	};
+
+	struct LeafNode : TreeNode {
+		uint8_t leaf;
+		float arg;
+		behavior::status tick(size_t agent, enemies::WalkerBatch& batch, float& timer) override {
+			return batch(leaf, arg, agent, timer);
+		}
+	};
+
+	// Node objects for the subtree at program.nodes[at]
+	inline std::unique_ptr<TreeNode> buildNodes(const behavior::Program& program, size_t at) {
+		const behavior::Node& node = program.nodes[at];
+		std::unique_ptr<TreeNode> result;
+		if (node.op == behavior::OP_LEAF) {
+			LeafNode* leaf = new LeafNode();
+			leaf->leaf = node.leaf;
+			leaf->arg = node.arg;
+			result.reset(leaf);
+		}
+		else if (node.op == behavior::OP_SEQUENCE)
+			result.reset(new SequenceNode());
+		else if (node.op == behavior::OP_SELECTOR)
+			result.reset(new SelectorNode());
+		else
+			result.reset(new InvertNode());
+		for (size_t child = at + 1; child < node.end; child = program.nodes[child].end)
+			result->children.push_back(buildNodes(program, child));
+		return result;
+	}
+
+	// AGENT_COUNT walkers with random senses run the default walker tree and a larger patrol tree
+	// Reports agents per millisecond of the compiled trees against node objects | Returns whether both decided the same
+	inline bool behaviors() {
+		const size_t AGENT_COUNT = 100000;
+		const int PASSES = 20;
+		const char* const PATROL =
+			"(selector\n"
+			"	(sequence (playerWithin 8) (canSeePlayer) (chase))\n"
+			"	(sequence (wallAhead) (onGround) (invert (playerWithin 4)) (wait 0.5) (turn))\n"
+			"	(sequence (onGround) (invert (wallAhead)) (selector (sequence (playerWithin 12) (jump 14)) (walk))))";
+
+		gameMap::Map map(nullptr, nullptr, nullptr);
+		gameMap::BlockHandle block = map.addBlockType();
+		buildFloor(map, block, 80);
+		for (unsigned int x = 8; x < 80; x += 16)
+			map.addBlock(glm::uvec2(x, 2), block);
+
+		std::mt19937 random(7);
+		std::uniform_real_distribution<float> across(0.0f, 64.0f), up(1.5f, 8.0f), coin(0.0f, 1.0f);
+		enemies::WalkerBatch senses;
+		senses.map = &map;
+		senses.playerPos = glm::vec2(32, 3);
+		senses.resize(AGENT_COUNT);
+		for (size_t i = 0; i < AGENT_COUNT; ++i) {
+			senses.pos[i] = glm::vec2(across(random), up(random));
+			senses.elapsed[i] = TICK_TIME;
+			senses.wallAhead[i] = coin(random) < 0.3f;
+			senses.onGround[i] = coin(random) < 0.8f;
+		}
+
+		const char* trees[] = { enemies::WALKER_BEHAVIOR, PATROL };
+		const char* names[] = { "walker", "patrol" };
+		bool same = true;
+		for (int t = 0; t < 2; ++t) {
+			behavior::Program program;
+			std::string error;
+			if (!behavior::compile(trees[t], enemies::walkerLeafNames(), program, error)) {
+				console::printError("behavior | " + error);
+				return false;
+			}
+			std::unique_ptr<TreeNode> root = buildNodes(program, 0);
+
+			std::vector<float> directions[2];
+			float ms[2];
+			for (int compiled = 1; compiled >= 0; --compiled) {
+				enemies::WalkerBatch batch = senses;
+				for (size_t i = 0; i < AGENT_COUNT; ++i) {
+					batch.direction[i] = i % 2 ? 1.0f : -1.0f;
+					batch.states[i] = behavior::makeAgent(0);
+				}
+				util::chrono::point start = util::chrono::now();
+				for (int pass = 0; pass < PASSES; ++pass) {
+					if (compiled) {
+						behavior::runBatch(program, batch.states.data(), 0, AGENT_COUNT, batch);
+					}
+					else {
+						for (size_t i = 0; i < AGENT_COUNT; ++i)
+							root->tick(i, batch, batch.states[i].timer);
+					}
+				}
+				ms[compiled] = msSince(start);
+				directions[compiled] = batch.direction;
+			}
+			console::printInfo(std::string("behavior | ") + names[t] + " | " + std::to_string(program.nodes.size()) + " nodes | agents " + std::to_string(AGENT_COUNT)
+				+ " | compiled " + std::to_string(AGENT_COUNT * PASSES / ms[1]) + " agents/ms | node objects " + std::to_string(AGENT_COUNT * PASSES / ms[0]) + " agents/ms"
+				+ " | decisions " + (directions[0] == directions[1] ? "match" : "DIFFER"));
+			same = same && directions[0] == directions[1];
+		}
+		return same;
+	}
+
+	// Tasks on the worker pool publishing EVENT_COUNT events a frame into the bus and into one mutex guarded vector
+	// Then bodies falling onto a floor on one and on all threads | Their landings have to match
+	inline void eventBus() {
+		const size_t EVENT_COUNT = 1 << 18;
+		const size_t TASKS = 64;
+		const int FRAMES = 20;
+		struct TestEvent {
+			uint32_t task, i;
+		};
+
+		jobs::WorkerPool pool;
+		events::EventBus bus(pool.threadCount());
+		bus.open<TestEvent>(EVENT_COUNT);
+		std::mutex mutex;
+		std::vector<TestEvent> locked;
+		locked.reserve(EVENT_COUNT);
+
+		float ms[2] = {};
+		size_t received[2] = {};
+		for (int frame = 0; frame < FRAMES; ++frame) {
+			util::chrono::point start = util::chrono::now();
+			pool.run(TASKS, [&](size_t task) {
+				for (uint32_t i = 0; i < EVENT_COUNT / TASKS; ++i)
+					bus.publish(TestEvent{ static_cast<uint32_t>(task), i });
+			});
+			bus.flush();
+			ms[0] += msSince(start);
+			received[0] += bus.read<TestEvent>().size();
+
+			start = util::chrono::now();
+			locked.clear();
+			pool.run(TASKS, [&](size_t task) {
+				for (uint32_t i = 0; i < EVENT_COUNT / TASKS; ++i) {
+					std::lock_guard<std::mutex> lock(mutex);
+					locked.push_back(TestEvent{ static_cast<uint32_t>(task), i });
+				}
+			});
+			ms[1] += msSince(start);
+			received[1] += locked.size();
+		}
+		console::printInfo("events | threads " + std::to_string(pool.threadCount()) + " | bus " + std::to_string(EVENT_COUNT * FRAMES / ms[0] / 1000) + " M events/s"
+			+ " | mutex " + std::to_string(EVENT_COUNT * FRAMES / ms[1] / 1000) + " M events/s | received " + std::to_string(received[0]) + " and " + std::to_string(received[1])
+			+ " of " + std::to_string(EVENT_COUNT * FRAMES) + " | dropped " + std::to_string(bus.dropped<TestEvent>()));
+
+		gameMap::Map map(nullptr, nullptr, nullptr);
+		gameMap::BlockHandle block = map.addBlockType();
+		buildFloor(map, block, 260);
+		jobs::WorkerPool serial(1);
+		std::vector<std::pair<physics::BodyHandle, float>> landings[2];
+		for (int threaded = 0; threaded < 2; ++threaded) {
+			jobs::WorkerPool& workers = threaded ? pool : serial;
+			events::EventBus landingBus(workers.threadCount());
+			landingBus.open<physics::LandingEvent>();
+			physics::World world(&map);
+			world.setWorkerPool(&workers);
+			world.setEventBus(&landingBus);
+			std::mt19937 rng(1234);
+			fillWorld(world, BODY_COUNT, false, rng);
+			for (int t = 0; t < TICKS; ++t) {
+				world.step(TICK_TIME);
+				landingBus.flush();
+				// Lanes depend on which thread ran which batch, sorting makes the order comparable
+				size_t first = landings[threaded].size();
+				for (const physics::LandingEvent& e : landingBus.read<physics::LandingEvent>())
+					landings[threaded].push_back(std::make_pair(e.body, e.speed));
+				std::sort(landings[threaded].begin() + first, landings[threaded].end());
+			}
+		}
+		console::printInfo("events | landings of " + std::to_string(BODY_COUNT) + " bodies over " + std::to_string(TICKS) + " ticks " + std::to_string(landings[1].size())
+			+ " | one and " + std::to_string(pool.threadCount()) + " threads " + (landings[0] == landings[1] ? "match" : "DIFFER"));
+	}
+
+	// Runs a 0.4 x 0.5 box along a floor into a wall 1 and 3 cells high at several speeds, pushing it on every tick
+	// The box has to end up on the floor, touching the wall's face | Returns whether every run did
+	inline bool walls() {
+		const float WALL_X = 20.0f;
+		const float SPEEDS[] = { 10.0f, 30.0f, 60.0f, 70.0f, 120.0f, 200.0f, 600.0f };
+		const unsigned int HEIGHTS[] = { 1, 3 };
+		bool ok = true;
+		for (unsigned int height : HEIGHTS) {
+			for (float speed : SPEEDS) {
+				gameMap::Map map(nullptr, nullptr, nullptr);
+				gameMap::BlockHandle block = map.addBlockType();
+				buildFloor(map, block, 64);
+				for (unsigned int y = 1; y <= height; ++y)
+					map.addBlock(glm::uvec2(static_cast<unsigned int>(WALL_X), y), block);
+
+				physics::World world(&map);
+				physics::BodyHandle box = world.addBody(glm::vec2(10.0f, 1.25f), glm::vec2(0.2f, 0.25f));
+				for (int t = 0; t < TICKS; ++t) {
+					world.setVelocity(box, glm::vec2(speed, world.getVelocity(box).y));
+					world.step(TICK_TIME);
+				}
+				glm::vec2 pos = world.getPos(box);
+				bool held = std::abs(pos.x - (WALL_X - 0.2f)) < 0.01f && std::abs(pos.y - 1.25f) < 0.01f;
+				ok = ok && held;
+				console::printInfo("walls | height " + std::to_string(height) + " | speed " + std::to_string(speed) + " | ends at "
+					+ std::to_string(pos.x) + " " + std::to_string(pos.y) + (held ? "" : " | CLIMBED"));
+			}
+		}
+		return ok;
+	}
+
+	// Broadphase candidates over the whole world that aren't bodies of it any more
+	inline size_t staleCandidates(const physics::World& world) {
+		std::vector<uint32_t> found;
+		world.getBroadphase().query(world.bounds(), glm::vec2(-1000.0f), glm::vec2(1000.0f), found);
+		size_t stale = 0;
+		for (uint32_t i : found)
+			stale += i >= world.size();
+		return stale;
+	}
+
+	// Circle and box cast queries over a removed body's spot that still report it or a handle no longer valid
+	inline size_t staleQueryHits(const physics::World& world, glm::vec2 spot, physics::BodyHandle removed) {
+		physics::WorldQuery query(world);
+		physics::CircleQuery circle = { spot, 1.0f };
+		physics::QueryRange range;
+		std::vector<physics::BodyHandle> touching;
+		query.circleOverlap(&circle, 1, &range, touching);
+		physics::BoxCast cast = { spot + glm::vec2(0.0f, 2.0f), glm::vec2(0.4f, 0.4f), glm::vec2(0.0f, -2.0f), physics::INVALID_BODY };
+		physics::CastHit hit;
+		query.boxCast(&cast, 1, &hit);
+		if (hit.body != physics::INVALID_BODY)
+			touching.push_back(hit.body);
+		size_t stale = 0;
+		for (physics::BodyHandle body : touching)
+			stale += body == removed || !world.isValid(body);
+		return stale;
+	}
+
+	// Removes a sleeping and an awake body and looks for broadphase entries and query results still pointing at them
+	// Then edits the cell next to the removed sleeper, whose broadphase query wakes bodies on the next step | Returns whether every check held
+	inline bool removal() {
+		gameMap::Map map(nullptr, nullptr, nullptr);
+		gameMap::BlockHandle block = map.addBlockType();
+		buildFloor(map, block, 32);
+		physics::World world(&map);
+		std::vector<physics::BodyHandle> bodies;
+		for (int i = 0; i < 10; ++i)
+			bodies.push_back(world.addBody(glm::vec2(2.0f + 2.0f * i, 1.5f), glm::vec2(0.4f, 0.4f)));
+		for (int t = 0; t < 10 * TICKS && world.awake() > 0; ++t)
+			world.step(TICK_TIME);
+		bool settled = world.awake() == 0;
+
+		glm::vec2 spot = world.getPos(bodies.back());
+		world.removeBody(bodies.back());
+		size_t staleAsleep = staleCandidates(world);
+		size_t hitsAsleep = staleQueryHits(world, spot, bodies.back());
+		map.addBlock(glm::uvec2(static_cast<unsigned int>(spot.x), 1), block);
+		world.step(TICK_TIME);
+		size_t staleEdited = staleCandidates(world);
+
+		physics::BodyHandle falling = world.addBody(glm::vec2(8.0f, 6.0f), glm::vec2(0.4f, 0.4f));
+		world.step(TICK_TIME);
+		glm::vec2 fallingSpot = world.getPos(falling);
+		world.removeBody(falling);
+		size_t staleAwake = staleCandidates(world);
+		size_t hitsAwake = staleQueryHits(world, fallingSpot, falling);
+		world.step(TICK_TIME);
+
+		bool ok = settled && staleAsleep == 0 && staleEdited == 0 && staleAwake == 0 && hitsAsleep == 0 && hitsAwake == 0 && world.size() == bodies.size() - 1;
+		console::printInfo("removal | settled " + std::string(settled ? "yes" : "no") + " | stale entries after removing asleep " + std::to_string(staleAsleep)
+			+ ", after the edit " + std::to_string(staleEdited) + ", after removing awake " + std::to_string(staleAwake)
+			+ " | stale query hits after removing asleep " + std::to_string(hitsAsleep) + ", awake " + std::to_string(hitsAwake) + " | " + (ok ? "ok" : "FAILED"));
+		return ok;
+	}
+
+	const size_t PARTICLE_COUNT = 100000;
+	const float PARTICLE_LIFETIME = 2.0f;
+
+	// Floor with pillars every 16 cells for the particles to bounce off
+	inline void buildParticleMap(gameMap::Map& map) {
+		gameMap::BlockHandle block = map.addBlockType();
+		buildFloor(map, block, 128);
+		for (unsigned int x = 8; x < 128; x += 16) {
+			for (unsigned int y = 1; y < 5; ++y)
+				map.addBlock(glm::uvec2(x, y), block);
+		}
+	}
+
+	// Rising dust, bouncing sparks and debris with one emitter each, keeping about PARTICLE_COUNT alive | Same scene on the CPU and the GPU system
+	template<typename System>
+	inline void addParticleScene(System& system, particles::MaterialId kinds[3]) {
+		particles::Material dust;
+		dust.gravityScale = -0.05f;
+		dust.drag = 1.5f;
+		dust.startSize = 0.1f;
+		dust.endSize = 0.4f;
+		particles::Material sparks;
+		sparks.collides = true;
+		particles::Material debris;
+		debris.collides = true;
+		debris.drag = 0.2f;
+		kinds[0] = system.addMaterial(dust);
+		kinds[1] = system.addMaterial(sparks);
+		kinds[2] = system.addMaterial(debris);
+		float rate = PARTICLE_COUNT / (3 * PARTICLE_LIFETIME);
+		for (int k = 0; k < 3; ++k)
+			system.addEmitter(particles::Emitter{ kinds[k], glm::vec2(20.0f + 40.0f * k, 8.0f), glm::vec2(0.0f, 4.0f), glm::vec2(12.0f, 6.0f), rate, PARTICLE_LIFETIME });
+	}
+
+	// Average CPU time of update and of buildInstances per frame, and the worst frame of both together against the 2 ms target
+	inline void particleSystem() {
+		const int WARMUP = 150, FRAMES = 240;
+		gameMap::Map map(nullptr, nullptr, nullptr);
+		buildParticleMap(map);
+
+		particles::ParticleSystem system(&map);
+		particles::MaterialId kinds[3];
+		addParticleScene(system, kinds);
+
+		for (int f = 0; f < WARMUP; ++f)
+			system.update(TICK_TIME);
+		float update = 0, instances = 0, worst = 0;
+		size_t alive = 0;
+		for (int f = 0; f < FRAMES; ++f) {
+			util::chrono::point start = util::chrono::now();
+			system.update(TICK_TIME);
+			float ms = msSince(start);
+			start = util::chrono::now();
+			system.buildInstances();
+			float built = msSince(start);
+			update += ms;
+			instances += built;
+			worst = std::max(worst, ms + built);
+			alive += system.size();
+		}
+		int draws = 0;
+		for (particles::MaterialId k : kinds)
+			draws += system.instanceCount(k) > 0;
+		console::printInfo("particles | alive " + std::to_string(alive / FRAMES) + " | update " + std::to_string(update / FRAMES) + " ms | instances "
+			+ std::to_string(instances / FRAMES) + " ms | worst frame " + std::to_string(worst) + " ms of 2 | draws " + std::to_string(draws) + " | dropped " + std::to_string(system.dropped));
+	}
+
+	// The particles scene on the CPU path and on the transform feedback path, drawn into a hidden window
+	// Simulating is update and instances on the CPU, spawn upload and update on the GPU | A frame adds the draw, with the CPU path's upload
+	// Every phase is timed until glFinish returns, so the GPU's share counts even when a driver runs it on the CPU
+	inline void gpuParticles() {
+		const int WARMUP = 150, FRAMES = 240;
+		GLFWwindow* window;
+		renderUtil::init::initGLFW(3);
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		renderUtil::init::createWindow(window, 320, 180, "Particles");
+		renderUtil::init::initGLcommands();
+		console::printInfo("gpu particles | " + std::string(reinterpret_cast<const char*>(glGetString(GL_RENDERER))));
+
+		gameMap::Map map(nullptr, nullptr, nullptr);
+		buildParticleMap(map);
+		glm::mat4 projection = glm::ortho(0.0f, 128.0f, 0.0f, 72.0f, 0.1f, 100.0f);
+		glm::mat4 view;
+		{
+			particles::ParticleSystem cpu(&map);
+			particles::ParticleRenderer renderer;
+			particles::GpuParticleSystem gpu(&map);
+			particles::MaterialId kinds[3];
+			addParticleScene(cpu, kinds);
+			addParticleScene(gpu, kinds);
+
+			for (int f = 0; f < WARMUP; ++f) {
+				cpu.update(TICK_TIME);
+				gpu.update(TICK_TIME);
+			}
+			glFinish();
+
+			float simulate[2] = { 0, 0 }, frame[2] = { 0, 0 };
+			size_t upload[2] = { 0, gpu.uploaded };
+			for (int f = 0; f < FRAMES; ++f) {
+				glClear(GL_COLOR_BUFFER_BIT);
+				util::chrono::point start = util::chrono::now();
+				cpu.update(TICK_TIME);
+				cpu.buildInstances();
+				simulate[0] += msSince(start);
+				upload[0] += cpu.instanceCount() * sizeof(particles::ParticleInstance);
+				renderer.draw(cpu, projection, view);
+				glFinish();
+				frame[0] += msSince(start);
+
+				glClear(GL_COLOR_BUFFER_BIT);
+				start = util::chrono::now();
+				gpu.update(TICK_TIME);
+				glFinish();
+				simulate[1] += msSince(start);
+				gpu.draw(projection, view);
+				glFinish();
+				frame[1] += msSince(start);
+			}
+
+			// Both paths draw the same random numbers in the same order, so lifetimes and the alive count agree
+			size_t alive = 0, slots = 0;
+			for (particles::MaterialId k : kinds) {
+				for (const particles::GpuParticle& p : gpu.readBack(k))
+					alive += p.instance.alpha > 0.0f;
+				slots += gpu.windowSize(k);
+			}
+			upload[1] = gpu.uploaded - upload[1];
+			std::string names[2] = { "cpu", "gpu" };
+			for (int path = 0; path < 2; ++path)
+				console::printInfo(names[path] + " | simulate " + std::to_string(simulate[path] / FRAMES) + " ms | frame " + std::to_string(frame[path] / FRAMES)
+					+ " ms | upload " + std::to_string(upload[path] / FRAMES / 1024) + " KB per frame");
+			console::printInfo("alive | cpu " + std::to_string(cpu.size()) + " | gpu " + std::to_string(alive) + " in " + std::to_string(slots) + " slots | dropped "
+				+ std::to_string(cpu.dropped) + " and " + std::to_string(gpu.dropped));
+		}
+		glfwTerminate();
+	}
+
+	inline int run(std::string name) {
+		if (name == "broadphase") {
+			broadphase();
+			return 0;
+		}
+		if (name == "sleep") {
+			sleep();
+			return 0;
+		}
+		if (name == "threads")
+			return threads() ? 0 : 1;
+		if (name == "stacking") {
+			stacking();
+			return 0;
+		}
+		if (name == "queries") {
+			queries();
+			return 0;
+		}
+		if (name == "detail") {
+			detail();
+			return 0;
+		}
+		if (name == "snapshot")
+			return snapshot() ? 0 : 1;
+		if (name == "stats") {
+			stats();
+			return 0;
+		}
+		if (name == "env") {
+			environments();
+			return 0;
+		}
+		if (name == "projectiles") {
+			projectiles();
+			return 0;
+		}
+		if (name == "ropes") {
+			ropes();
+			return 0;
+		}
+		if (name == "entities") {
+			entities();
+			return 0;
+		}
+		if (name == "jobs")
+			return frameGraph() ? 0 : 1;
+		if (name == "ai") {
+			agents();
+			return 0;
+		}
+		if (name == "behavior")
+			return behaviors() ? 0 : 1;
+		if (name == "events") {
+			eventBus();
+			return 0;
+		}
+		if (name == "particles") {
+			particleSystem();
+			return 0;
+		}
+		if (name == "gpuparticles") {
+			gpuParticles();
+			return 0;
+		}
+		if (name == "replay")
+			return replay::verifyDemo();
+		if (name == "walls")
+			return walls() ? 0 : 1;
+		if (name == "removal")
+			return removal() ? 0 : 1;
+		if (name == "ropewall")
+			return ropeWall() ? 0 : 1;
+		console::printError("Benchmark: Unknown benchmark [" + name + "]");
+		return -1;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,513 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include "Fixed.hpp"
+
+
+namespace physics {
+
+	// Two bodies by dense index | a < b
+	struct BodyPair {
+		uint32_t a, b;
+	};
+
+	// Read-only view of the world's bodies | Slots stay stable across ticks, dense indices don't
+	struct BodyBounds {
+		// Bodies [0, awake) may have moved, bodies [awake, asleep) sit this tick out, bodies [asleep, count) are asleep or frozen
+		size_t count, awake, asleep;
+		// Changes whenever a body falls asleep or is removed
+		uint32_t sleepVersion;
+		// Changes whenever the bodies sitting this tick out may have moved since the last update, or a body is removed
+		uint32_t parkedVersion;
+		// Boxes are enlarged by margin so resting contacts are found before they overlap
+		real margin;
+		const real* posX;
+		const real* posY;
+		const real* halfW;
+		const real* halfH;
+		// Dense index -> slot and slot -> dense index
+		const uint32_t* slots;
+		const uint32_t* slotIndex;
+
+		// Computed in the simulation's number type, only the result is converted
+		glm::vec2 boxMin(uint32_t i) const {
+			return glm::vec2(toFloat(posX[i] - halfW[i] - margin), toFloat(posY[i] - halfH[i] - margin));
+		}
+
+		glm::vec2 boxMax(uint32_t i) const {
+			return glm::vec2(toFloat(posX[i] + halfW[i] + margin), toFloat(posY[i] + halfH[i] + margin));
+		}
+
+		bool isAsleep(uint32_t i) const {
+			return i >= asleep;
+		}
+
+		bool isParked(uint32_t i) const {
+			return i >= awake && i < asleep;
+		}
+	};
+
+	inline bool overlaps(glm::vec2 minA, glm::vec2 maxA, glm::vec2 minB, glm::vec2 maxB) {
+		return minA.x < maxB.x && minB.x < maxA.x && minA.y < maxB.y && minB.y < maxA.y;
+	}
+
+	// Finds pairs of bodies whose boxes overlap without testing every pair
+	// Sleeping and parked bodies are kept but only paired with awake ones, so the per tick cost follows the awake bodies
+	class Broadphase {
+	public:
+		// Number of box tests done by the last findPairs
+		size_t candidates = 0;
+
+		virtual ~Broadphase() {}
+
+		// Brings the structure up to date with the current body bounds
+		virtual void update(const BodyBounds& bodies) = 0;
+
+		// Forgets a removed body
+		virtual void remove(uint32_t slot) = 0;
+
+		// Appends every overlapping pair with at least one awake body exactly once
+		virtual void findPairs(const BodyBounds& bodies, std::vector<BodyPair>& pairs) = 0;
+
+		// Appends the dense index of every body, awake or asleep, overlapping [min, max]
+		virtual void query(const BodyBounds& bodies, glm::vec2 min, glm::vec2 max, std::vector<uint32_t>& result) const = 0;
+	};
+
+	// Uniform grid | Bodies are bucketed into every cell they touch, keyed by the cell coordinates
+	// Awake bodies are rebucketed every update, sleeping and parked ones only when their set changes
+	class SpatialHash : public Broadphase {
+	private:
+		struct Entry {
+			uint64_t cell;
+			uint32_t slot;
+
+			bool operator<(const Entry& other) const {
+				return cell < other.cell || (cell == other.cell && slot < other.slot);
+			}
+		};
+
+		// Open addressing table from a cell to its run of sorted entries | Lets queries skip the binary search
+		struct CellIndex {
+			struct Run {
+				uint64_t cell;
+				// end is 0 for free table entries
+				uint32_t begin, end;
+			};
+			std::vector<Run> table;
+			size_t mask = 0;
+
+			static size_t hash(uint64_t cell) {
+				return static_cast<size_t>((cell * 0x9E3779B97F4A7C15ull) >> 32);
+			}
+
+			void build(const std::vector<Entry>& entries) {
+				size_t runs = 0;
+				for (size_t i = 0; i < entries.size(); ++i)
+					runs += i == 0 || entries[i].cell != entries[i - 1].cell;
+				size_t capacity = 16;
+				while (capacity < runs * 2)
+					capacity *= 2;
+				table.assign(capacity, { 0, 0, 0 });
+				mask = capacity - 1;
+
+				size_t begin = 0;
+				while (begin < entries.size()) {
+					size_t end = begin + 1;
+					while (end < entries.size() && entries[end].cell == entries[begin].cell)
+						++end;
+					size_t i = hash(entries[begin].cell) & mask;
+					while (table[i].end != 0)
+						i = (i + 1) & mask;
+					table[i] = { entries[begin].cell, static_cast<uint32_t>(begin), static_cast<uint32_t>(end) };
+					begin = end;
+				}
+			}
+
+			// Empty run if no entry lies in the cell
+			Run find(uint64_t cell) const {
+				if (table.empty())
+					return { cell, 0, 0 };
+				for (size_t i = hash(cell) & mask;; i = (i + 1) & mask) {
+					if (table[i].end == 0 || table[i].cell == cell)
+						return table[i];
+				}
+			}
+		};
+
+		float cellSize;
+		std::vector<Entry> awakeEntries, sleepingEntries, parkedEntries;
+		CellIndex awakeIndex, sleepingIndex, parkedIndex;
+		uint32_t sleepVersion = 0xFFFFFFFF, parkedVersion = 0xFFFFFFFF;
+		// Enlarged boxes by slot
+		std::vector<glm::vec2> boxMin, boxMax;
+		// Slots removed since they were last bucketed | Their entries linger until the lists are rebuilt and are skipped until then
+		std::vector<uint8_t> removed;
+
+		int cellOf(float v) const {
+			return static_cast<int>(std::floor(v / cellSize));
+		}
+
+		static uint64_t key(int x, int y) {
+			return (uint64_t(uint32_t(y)) << 32) | uint32_t(x);
+		}
+
+		void bucket(const BodyBounds& bodies, uint32_t i, std::vector<Entry>& entries) {
+			uint32_t slot = bodies.slots[i];
+			if (slot >= boxMin.size()) {
+				boxMin.resize(slot + 1);
+				boxMax.resize(slot + 1);
+				removed.resize(slot + 1, 0);
+			}
+			removed[slot] = 0;
+			boxMin[slot] = bodies.boxMin(i);
+			boxMax[slot] = bodies.boxMax(i);
+
+			int x0 = cellOf(boxMin[slot].x), x1 = cellOf(boxMax[slot].x);
+			int y0 = cellOf(boxMin[slot].y), y1 = cellOf(boxMax[slot].y);
+			for (int y = y0; y <= y1; ++y) {
+				for (int x = x0; x <= x1; ++x) {
+					entries.push_back({ key(x, y), slot });
+				}
+			}
+		}
+
+		void rebuild(const BodyBounds& bodies, size_t begin, size_t end, std::vector<Entry>& entries, CellIndex& index) {
+			entries.clear();
+			for (uint32_t i = static_cast<uint32_t>(begin); i < end; ++i)
+				bucket(bodies, i, entries);
+			std::sort(entries.begin(), entries.end());
+			index.build(entries);
+		}
+
+		// Only the cell holding the corner of the intersection reports a pair
+		bool ownsPair(uint64_t cell, uint32_t a, uint32_t b) const {
+			glm::vec2 corner = glm::max(boxMin[a], boxMin[b]);
+			return key(cellOf(corner.x), cellOf(corner.y)) == cell;
+		}
+
+		// Removed bodies linger in every list until its next rebuild | A removed slot's dense index is past count until the slot is reused
+		bool live(const BodyBounds& bodies, uint32_t slot) const {
+			return !removed[slot] && bodies.slotIndex[slot] < bodies.count;
+		}
+
+		// Woken or resumed bodies linger in sleepingEntries and parkedEntries until the next rebuild
+		bool stillListed(const BodyBounds& bodies, int list, uint32_t slot) const {
+			if (!live(bodies, slot))
+				return false;
+			return list == 0 ? bodies.isAsleep(bodies.slotIndex[slot]) : bodies.isParked(bodies.slotIndex[slot]);
+		}
+	public:
+		SpatialHash(float cellSize = 2.0f)
+			: cellSize(cellSize) {}
+
+		void update(const BodyBounds& bodies) override {
+			rebuild(bodies, 0, bodies.awake, awakeEntries, awakeIndex);
+			if (bodies.sleepVersion != sleepVersion) {
+				sleepVersion = bodies.sleepVersion;
+				rebuild(bodies, bodies.asleep, bodies.count, sleepingEntries, sleepingIndex);
+			}
+			if (bodies.parkedVersion != parkedVersion) {
+				parkedVersion = bodies.parkedVersion;
+				rebuild(bodies, bodies.awake, bodies.asleep, parkedEntries, parkedIndex);
+			}
+		}
+
+		// The world bumps both versions when it removes a body, so the next update drops the slot's entries for good
+		void remove(uint32_t slot) override {
+			if (slot < removed.size())
+				removed[slot] = 1;
+		}
+
+		void findPairs(const BodyBounds& bodies, std::vector<BodyPair>& pairs) override {
+			candidates = 0;
+			const std::vector<Entry>* still[2] = { &sleepingEntries, &parkedEntries };
+			size_t cursor[2] = { 0, 0 };
+			size_t runStart = 0;
+			while (runStart < awakeEntries.size()) {
+				uint64_t cell = awakeEntries[runStart].cell;
+				size_t runEnd = runStart + 1;
+				while (runEnd < awakeEntries.size() && awakeEntries[runEnd].cell == cell)
+					++runEnd;
+
+				for (int list = 0; list < 2; ++list) {
+					while (cursor[list] < still[list]->size() && (*still[list])[cursor[list]].cell < cell)
+						++cursor[list];
+				}
+
+				for (size_t i = runStart; i < runEnd; ++i) {
+					uint32_t a = awakeEntries[i].slot;
+					for (size_t j = i + 1; j < runEnd; ++j) {
+						uint32_t b = awakeEntries[j].slot;
+						++candidates;
+						if (overlaps(boxMin[a], boxMax[a], boxMin[b], boxMax[b]) && ownsPair(cell, a, b)) {
+							uint32_t ia = bodies.slotIndex[a], ib = bodies.slotIndex[b];
+							pairs.push_back({ std::min(ia, ib), std::max(ia, ib) });
+						}
+					}
+					for (int list = 0; list < 2; ++list) {
+						const std::vector<Entry>& entries = *still[list];
+						for (size_t j = cursor[list]; j < entries.size() && entries[j].cell == cell; ++j) {
+							uint32_t b = entries[j].slot;
+							if (!stillListed(bodies, list, b))
+								continue;
+							++candidates;
+							if (overlaps(boxMin[a], boxMax[a], boxMin[b], boxMax[b]) && ownsPair(cell, a, b))
+								pairs.push_back({ bodies.slotIndex[a], bodies.slotIndex[b] });
+						}
+					}
+				}
+				runStart = runEnd;
+			}
+		}
+
+		void query(const BodyBounds& bodies, glm::vec2 min, glm::vec2 max, std::vector<uint32_t>& result) const override {
+			int x0 = cellOf(min.x), x1 = cellOf(max.x);
+			int y0 = cellOf(min.y), y1 = cellOf(max.y);
+			for (int y = y0; y <= y1; ++y) {
+				for (int x = x0; x <= x1; ++x) {
+					uint64_t cell = key(x, y);
+					for (int list = 0; list < 3; ++list) {
+						const std::vector<Entry>& entries = list == 0 ? awakeEntries : list == 1 ? sleepingEntries : parkedEntries;
+						CellIndex::Run run = (list == 0 ? awakeIndex : list == 1 ? sleepingIndex : parkedIndex).find(cell);
+						for (uint32_t e = run.begin; e < run.end; ++e) {
+							uint32_t b = entries[e].slot;
+							if (list == 0 ? !live(bodies, b) : !stillListed(bodies, list - 1, b))
+								continue;
+							if (!overlaps(min, max, boxMin[b], boxMax[b]))
+								continue;
+							// Same dedup rule as findPairs
+							glm::vec2 corner = glm::max(min, boxMin[b]);
+							if (key(cellOf(corner.x), cellOf(corner.y)) != cell)
+								continue;
+							result.push_back(bodies.slotIndex[b]);
+						}
+					}
+				}
+			}
+		}
+	};
+
+	const int32_t NULL_NODE = -1;
+
+	// Dynamic bounding volume tree | Leaves keep an enlarged box so slow bodies only touch the tree occasionally
+	class AabbTree : public Broadphase {
+	private:
+		struct Node {
+			glm::vec2 min, max;
+			int32_t parent = NULL_NODE, child1 = NULL_NODE, child2 = NULL_NODE;
+			// Leaves only
+			uint32_t slot = 0;
+
+			bool isLeaf() const {
+				return child1 == NULL_NODE;
+			}
+		};
+
+		float margin;
+		std::vector<Node> nodes;
+		std::vector<int32_t> freeNodes;
+		int32_t root = NULL_NODE;
+		uint32_t sleepVersion = 0xFFFFFFFF, parkedVersion = 0xFFFFFFFF;
+
+		// Slot -> leaf node | NULL_NODE if the slot has no body
+		std::vector<int32_t> slotLeaf;
+		// Tight boxes by slot
+		std::vector<glm::vec2> boxMin, boxMax;
+		std::vector<int32_t> stack;
+
+		static float perimeter(glm::vec2 min, glm::vec2 max) {
+			return 2 * ((max.x - min.x) + (max.y - min.y));
+		}
+
+		int32_t allocateNode() {
+			if (freeNodes.empty()) {
+				nodes.push_back(Node());
+				return static_cast<int32_t>(nodes.size()) - 1;
+			}
+			int32_t id = freeNodes.back();
+			freeNodes.pop_back();
+			nodes[id] = Node();
+			return id;
+		}
+
+		void refit(int32_t node) {
+			while (node != NULL_NODE) {
+				Node& n = nodes[node];
+				n.min = glm::min(nodes[n.child1].min, nodes[n.child2].min);
+				n.max = glm::max(nodes[n.child1].max, nodes[n.child2].max);
+				node = n.parent;
+			}
+		}
+
+		void insertLeaf(int32_t leaf) {
+			if (root == NULL_NODE) {
+				root = leaf;
+				nodes[leaf].parent = NULL_NODE;
+				return;
+			}
+
+			// Descend towards the child whose box grows the least
+			glm::vec2 leafMin = nodes[leaf].min, leafMax = nodes[leaf].max;
+			int32_t sibling = root;
+			while (!nodes[sibling].isLeaf()) {
+				const Node& n = nodes[sibling];
+				const Node& c1 = nodes[n.child1];
+				const Node& c2 = nodes[n.child2];
+				float cost1 = perimeter(glm::min(c1.min, leafMin), glm::max(c1.max, leafMax)) - perimeter(c1.min, c1.max);
+				float cost2 = perimeter(glm::min(c2.min, leafMin), glm::max(c2.max, leafMax)) - perimeter(c2.min, c2.max);
+				sibling = cost1 <= cost2 ? n.child1 : n.child2;
+			}
+
+			int32_t oldParent = nodes[sibling].parent;
+			int32_t newParent = allocateNode();
+			nodes[newParent].parent = oldParent;
+			nodes[newParent].child1 = sibling;
+			nodes[newParent].child2 = leaf;
+			nodes[sibling].parent = newParent;
+			nodes[leaf].parent = newParent;
+
+			if (oldParent == NULL_NODE)
+				root = newParent;
+			else if (nodes[oldParent].child1 == sibling)
+				nodes[oldParent].child1 = newParent;
+			else
+				nodes[oldParent].child2 = newParent;
+
+			refit(newParent);
+		}
+
+		void removeLeaf(int32_t leaf) {
+			if (leaf == root) {
+				root = NULL_NODE;
+				return;
+			}
+
+			int32_t parent = nodes[leaf].parent;
+			int32_t grandParent = nodes[parent].parent;
+			int32_t sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+			if (grandParent == NULL_NODE) {
+				root = sibling;
+				nodes[sibling].parent = NULL_NODE;
+			}
+			else {
+				if (nodes[grandParent].child1 == parent)
+					nodes[grandParent].child1 = sibling;
+				else
+					nodes[grandParent].child2 = sibling;
+				nodes[sibling].parent = grandParent;
+				refit(grandParent);
+			}
+			freeNodes.push_back(parent);
+		}
+
+		void updateBody(const BodyBounds& bodies, uint32_t i) {
+			uint32_t slot = bodies.slots[i];
+			if (slot >= slotLeaf.size()) {
+				slotLeaf.resize(slot + 1, NULL_NODE);
+				boxMin.resize(slot + 1);
+				boxMax.resize(slot + 1);
+			}
+			boxMin[slot] = bodies.boxMin(i);
+			boxMax[slot] = bodies.boxMax(i);
+
+			int32_t leaf = slotLeaf[slot];
+			if (leaf != NULL_NODE) {
+				const Node& n = nodes[leaf];
+				if (boxMin[slot].x >= n.min.x && boxMin[slot].y >= n.min.y && boxMax[slot].x <= n.max.x && boxMax[slot].y <= n.max.y)
+					return;
+				removeLeaf(leaf);
+			}
+			else {
+				leaf = allocateNode();
+				nodes[leaf].slot = slot;
+				slotLeaf[slot] = leaf;
+			}
+			nodes[leaf].min = boxMin[slot] - glm::vec2(margin);
+			nodes[leaf].max = boxMax[slot] + glm::vec2(margin);
+			insertLeaf(leaf);
+		}
+	public:
+		AabbTree(float margin = 0.25f)
+			: margin(margin) {}
+
+		void update(const BodyBounds& bodies) override {
+			for (uint32_t i = 0; i < bodies.awake; ++i)
+				updateBody(bodies, i);
+
+			// Picks up sleeping bodies the tree has not seen yet, e.g. after switching broadphase
+			if (bodies.sleepVersion != sleepVersion) {
+				sleepVersion = bodies.sleepVersion;
+				for (uint32_t i = static_cast<uint32_t>(bodies.asleep); i < bodies.count; ++i)
+					updateBody(bodies, i);
+			}
+			// Parked bodies last moved while they were awake, after that update
+			if (bodies.parkedVersion != parkedVersion) {
+				parkedVersion = bodies.parkedVersion;
+				for (uint32_t i = static_cast<uint32_t>(bodies.awake); i < bodies.asleep; ++i)
+					updateBody(bodies, i);
+			}
+		}
+
+		void remove(uint32_t slot) override {
+			if (slot >= slotLeaf.size() || slotLeaf[slot] == NULL_NODE)
+				return;
+			removeLeaf(slotLeaf[slot]);
+			freeNodes.push_back(slotLeaf[slot]);
+			slotLeaf[slot] = NULL_NODE;
+		}
+
+		void findPairs(const BodyBounds& bodies, std::vector<BodyPair>& pairs) override {
+			candidates = 0;
+			if (root == NULL_NODE)
+				return;
+			for (uint32_t a = 0; a < bodies.awake; ++a) {
+				uint32_t slotA = bodies.slots[a];
+				stack.clear();
+				stack.push_back(root);
+				while (!stack.empty()) {
+					const Node& n = nodes[stack.back()];
+					stack.pop_back();
+					if (!overlaps(n.min, n.max, boxMin[slotA], boxMax[slotA]))
+						continue;
+					if (!n.isLeaf()) {
+						stack.push_back(n.child1);
+						stack.push_back(n.child2);
+						continue;
+					}
+					uint32_t b = bodies.slotIndex[n.slot];
+					// Awake pairs are found from their lower index, sleeping partners only from the awake side
+					if (b <= a)
+						continue;
+					++candidates;
+					if (overlaps(boxMin[slotA], boxMax[slotA], boxMin[n.slot], boxMax[n.slot]))
+						pairs.push_back({ a, b });
+				}
+			}
+		}
+
+		void query(const BodyBounds& bodies, glm::vec2 min, glm::vec2 max, std::vector<uint32_t>& result) const override {
+			if (root == NULL_NODE)
+				return;
+			// Queries run on many threads at once, each keeps its stack between calls
+			static thread_local std::vector<int32_t> pending;
+			pending.assign(1, root);
+			while (!pending.empty()) {
+				const Node& n = nodes[pending.back()];
+				pending.pop_back();
+				if (!overlaps(n.min, n.max, min, max))
+					continue;
+				if (!n.isLeaf()) {
+					pending.push_back(n.child1);
+					pending.push_back(n.child2);
+					continue;
+				}
+				if (overlaps(min, max, boxMin[n.slot], boxMax[n.slot]))
+					result.push_back(bodies.slotIndex[n.slot]);
+			}
+		}
+	};
+}
\ No newline at end of file
@@ -0,0 +1,217 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include "Map.hpp"
+#include "Fixed.hpp"
+
+
+namespace physics {
+
+	// Tolerance so boxes resting exactly on a face don't count as overlapping that cell
+	const real SKIN = toReal(1e-4f);
+	// Longest piece a horizontal move is swept in | Surfaces are at most 45 degrees steep, so a piece climbs at most its own length
+	// and never a face a whole cell above the box bottom, however fast the box goes
+	const real MAX_STEP = toReal(0.5f);
+
+	// Cells the sweeps and probes of this thread looked at | World reads it around its batches for the step statistics
+	inline uint32_t& probedCells() {
+		static thread_local uint32_t count = 0;
+		return count;
+	}
+
+	// Every cell lookup of the sweeps goes through here to be counted
+	inline const gameMap::CollisionShape& probe(const gameMap::Map& map, int x, int y) {
+		++probedCells();
+		return map.shapeAt(x, y);
+	}
+
+	struct SweepResult {
+		real x, y;
+		bool hitX = false, hitY = false;
+	};
+
+	// Highest point of a cell's surface over [from, to] | Surfaces are linear so it sits at one of the two ends
+	inline real surfaceTop(const gameMap::CollisionShape& shape, int column, real from, real to) {
+		real a = std::max(from - real(column), real(0));
+		real b = std::min(to - real(column), real(1));
+		real slope = shape.right - shape.left;
+		return std::max(shape.left + slope * a, shape.left + slope * b);
+	}
+
+	// Whether the side face a box moving in dir runs into stops it | Faces reaching no higher than step above the box bottom are walked onto
+	// step is the length of the move, at most MAX_STEP, which is as far as a slope could have risen along it
+	inline bool sideBlocks(const gameMap::CollisionShape& shape, int row, int dir, real bottom, real step) {
+		if (!shape.walls)
+			return false;
+		real face = real(row) + (dir > 0 ? shape.left : shape.right);
+		return face > bottom + step + SKIN;
+	}
+
+	// Falling box against the cell surfaces below it | Surfaces the box bottom already sits under are ignored
+	inline real sweepDown(const gameMap::Map& map, const real min[2], const real max[2], real delta, bool& hit) {
+		int firstLane = floorToInt(min[0] + SKIN);
+		int lastLane = ceilToInt(max[0] - SKIN) - 1;
+		int from = floorToInt(min[1] - SKIN);
+		int to = floorToInt(min[1] + delta);
+
+		// Surfaces of a row lie within it, so the first row with a hit holds the highest one
+		for (int row = from; row >= to; --row) {
+			bool found = false;
+			real highest = min[1] + delta;
+			for (int lane = firstLane; lane <= lastLane; ++lane) {
+				const gameMap::CollisionShape& shape = probe(map, lane, row);
+				if (!shape.top)
+					continue;
+				real surface = real(row) + surfaceTop(shape, lane, min[0], max[0]);
+				if (surface <= min[1] + SKIN && surface >= highest) {
+					highest = surface;
+					found = true;
+				}
+			}
+			if (found) {
+				hit = true;
+				return std::min(highest - min[1], real(0));
+			}
+		}
+		return delta;
+	}
+
+	// Moves the box [min, max] by delta along one axis (0 = x, 1 = y) through the tile grid
+	// Only the cells the leading face passes are visited | Returns the distance travelled before the first blocking cell
+	inline real sweepAxis(const gameMap::Map& map, int axis, const real min[2], const real max[2], real delta, bool& hit) {
+		hit = false;
+		if (delta == real(0))
+			return delta;
+		if (axis == 1 && delta < real(0))
+			return sweepDown(map, min, max, delta, hit);
+
+		int other = 1 - axis;
+		int firstLane = floorToInt(min[other] + SKIN);
+		int lastLane = ceilToInt(max[other] - SKIN) - 1;
+
+		// Cells past the grid never block, so the walk stops one beyond its edge however far the move goes
+		int limit = static_cast<int>(axis == 0 ? map.gridSize().x : map.gridSize().y);
+		int step, from, to;
+		if (delta > real(0)) {
+			step = 1;
+			from = ceilToInt(max[axis] - SKIN);
+			to = max[axis] + delta > real(limit) ? limit : ceilToInt(max[axis] + delta) - 1;
+		}
+		else {
+			step = -1;
+			from = floorToInt(min[axis] + SKIN) - 1;
+			to = min[axis] + delta < real(-1) ? -1 : floorToInt(min[axis] + delta);
+		}
+
+		for (int cell = from; step > 0 ? cell <= to : cell >= to; cell += step) {
+			for (int lane = firstLane; lane <= lastLane; ++lane) {
+				bool blocks = axis == 0
+					? sideBlocks(probe(map, cell, lane), lane, step, min[1], abs(delta))
+					: probe(map, lane, cell).walls;
+				if (blocks) {
+					hit = true;
+					return step > 0 ? real(cell) - max[axis] : real(cell + 1) - min[axis];
+				}
+			}
+		}
+		return delta;
+	}
+
+	// How far the box [min, max] has to rise to stand on every surface it sank into by at most maxStep
+	// Carries boxes up slopes after a sideways move | One-way platforms never lift
+	inline real stepUp(const gameMap::Map& map, const real min[2], const real max[2], real maxStep) {
+		int firstLane = floorToInt(min[0] + SKIN);
+		int lastLane = ceilToInt(max[0] - SKIN) - 1;
+		real lift = real(0);
+		for (int row = floorToInt(min[1] + SKIN); row <= floorToInt(min[1] + maxStep); ++row) {
+			for (int lane = firstLane; lane <= lastLane; ++lane) {
+				const gameMap::CollisionShape& shape = probe(map, lane, row);
+				if (!shape.walls)
+					continue;
+				real rise = real(row) + surfaceTop(shape, lane, min[0], max[0]) - min[1];
+				if (rise > lift && rise <= maxStep + SKIN)
+					lift = rise;
+			}
+		}
+		return lift;
+	}
+
+	// Looks for surfaces within maxGap of the box bottom, above or below | Picks the highest one
+	inline bool probeGround(const gameMap::Map& map, const real min[2], const real max[2], real maxGap, real& gap) {
+		int firstLane = floorToInt(min[0] + SKIN);
+		int lastLane = ceilToInt(max[0] - SKIN) - 1;
+		bool found = false;
+		for (int row = floorToInt(min[1] - maxGap); row <= floorToInt(min[1] + maxGap); ++row) {
+			for (int lane = firstLane; lane <= lastLane; ++lane) {
+				const gameMap::CollisionShape& shape = probe(map, lane, row);
+				if (!shape.top)
+					continue;
+				real distance = min[1] - real(row) - surfaceTop(shape, lane, min[0], max[0]);
+				// A box inside a one-way platform is passing through it
+				real deepest = shape.walls ? -maxGap : -SKIN;
+				if (distance > maxGap || distance < deepest || (found && distance >= gap))
+					continue;
+				gap = distance;
+				found = true;
+			}
+		}
+		return found;
+	}
+
+	// Looks for blocking cells within maxGap beyond one face of the box [min, max] | dir is -1 or 1 along axis
+	// gap is the distance from the face to those cells, negative if the box already sinks into them
+	inline bool probeFace(const gameMap::Map& map, int axis, const real min[2], const real max[2], int dir, real maxGap, real& gap) {
+		if (axis == 1 && dir < 0)
+			return probeGround(map, min, max, maxGap, gap);
+
+		int other = 1 - axis;
+		int firstLane = floorToInt(min[other] + SKIN);
+		int lastLane = ceilToInt(max[other] - SKIN) - 1;
+
+		real face = dir > 0 ? max[axis] : min[axis];
+		int cell = floorToInt(dir > 0 ? face + maxGap : face - maxGap);
+		gap = dir > 0 ? real(cell) - face : face - real(cell + 1);
+
+		for (int lane = firstLane; lane <= lastLane; ++lane) {
+			bool blocks = axis == 0
+				? sideBlocks(probe(map, cell, lane), lane, dir, min[1], maxGap)
+				: probe(map, lane, cell).walls;
+			if (blocks)
+				return true;
+		}
+		return false;
+	}
+
+	// Moves a box given by center and half extents by (dx, dy), resolving x first and y second
+	// x goes in pieces of at most MAX_STEP, each lifting the box by as much as the surfaces under it rose | Slower moves are one piece
+	// No more pieces than it takes to cross the grid, the last one takes the rest in one sweep | A move that isn't finite is none
+	inline SweepResult sweepBox(const gameMap::Map& map, real x, real y, real halfW, real halfH, real dx, real dy) {
+		SweepResult result;
+		real min[2] = { x - halfW, y - halfH };
+		real max[2] = { x + halfW, y + halfH };
+		real movedX = real(0), lift = real(0);
+		real remaining = isFinite(dx) ? dx : real(0);
+		int maxPieces = ceilToInt(real(static_cast<int>(map.gridSize().x)) / MAX_STEP) + 1;
+		int pieces = abs(remaining) > real(maxPieces) * MAX_STEP ? maxPieces : ceilToInt(abs(remaining) / MAX_STEP);
+		for (int p = 0; p < pieces; ++p) {
+			real piece = p + 1 == pieces ? remaining : remaining > MAX_STEP ? MAX_STEP : remaining < -MAX_STEP ? -MAX_STEP : remaining;
+			real moved = sweepAxis(map, 0, min, max, piece, result.hitX);
+			min[0] += moved;
+			max[0] += moved;
+			movedX += moved;
+
+			real rise = moved != real(0) ? stepUp(map, min, max, abs(moved)) : real(0);
+			min[1] += rise;
+			max[1] += rise;
+			lift += rise;
+			if (result.hitX)
+				break;
+			remaining -= piece;
+		}
+
+		real movedY = sweepAxis(map, 1, min, max, isFinite(dy) ? dy : real(0), result.hitY);
+		result.x = x + movedX;
+		result.y = y + lift + movedY;
+		return result;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,68 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <own/modelloader.hpp>
+#include "ECS.hpp"
+#include "World.hpp"
+
+
+// Components of the game's entities | Systems that need the physics live in PhysicsHandler, drawing is here
+// A new kind of enemy is a new combination of components plus, if it behaves differently, one more loop over them
+namespace gameEntity {
+
+	// Position of the last and the current physics tick | Rendering interpolates between them
+	struct Motion {
+		glm::vec2 pos, prevPos;
+		// Units per second
+		glm::vec2 velocity;
+	};
+
+	// Body size and walking speed of anything that runs around
+	struct Runner {
+		glm::vec2 halfExtents = glm::vec2(0.5f, 1.0f);
+		// Units per second
+		float runSpeed = 18.0f;
+	};
+
+	// Link to the entity's body in the physics World
+	struct PhysicsBody {
+		physics::BodyHandle handle;
+	};
+
+	// Steered by the keyboard
+	struct PlayerControl {};
+
+	// Walks at its Runner speed the way its behavior decides | direction is -1 or 1
+	struct Walker {
+		float direction;
+		// Upward speed to jump with on the next tick, 0 for none | Set by the behavior, used up by the physics
+		float jump;
+	};
+
+	// Falling into a kill zone puts the entity back here
+	struct Respawn {
+		glm::vec2 spawn;
+	};
+
+	// Model and texture drawn at the interpolated Motion | offset is added to the body center
+	struct Sprite {
+		int model, texture;
+		glm::vec2 offset;
+	};
+
+	// Position to draw at | alpha is the fraction of a tick passed since the last physics update
+	inline glm::vec2 renderPos(const Motion& motion, float alpha) {
+		return glm::mix(motion.prevPos, motion.pos, alpha);
+	}
+
+	// Draws every entity with a Motion and a Sprite
+	inline void drawSprites(ecs::Registry& registry, modelLoader::ModelContainer& models, renderUtil::TextureEngine& textures, renderUtil::ShaderEngine& shader, float alpha) {
+		registry.each<Motion, Sprite>([&](ecs::Entity, Motion& motion, Sprite& sprite) {
+			glm::vec2 pos = renderPos(motion, alpha) + sprite.offset;
+			textures.use(sprite.texture);
+			glm::mat4 model;
+			model = glm::translate(model, glm::vec3(pos.x, pos.y, -2));
+			shader.setMat4("model", model);
+			models.draw(sprite.model);
+		});
+	}
+}
\ No newline at end of file
@@ -0,0 +1,330 @@
+#pragma once
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <string>
+#include <own/helper.hpp>
+#include "StateBuffer.hpp"
+
+
+// Entities are ids, components plain structs, systems free functions looping over the components they need
+// Entities with the same set of components share an archetype, which keeps each component in one contiguous array
+namespace ecs {
+
+	// Slot in the low 20 bits, generation in the high 12 | A destroyed entity's id never matches its slot's next user
+	typedef uint32_t Entity;
+	const Entity NO_ENTITY = 0xFFFFFFFF;
+
+	// One bit per component type
+	typedef uint32_t ComponentMask;
+	const uint32_t MAX_COMPONENTS = 32;
+
+	// Size of every component type that got an id, indexed by id
+	inline std::vector<uint32_t>& componentSizes() {
+		static std::vector<uint32_t> sizes;
+		return sizes;
+	}
+
+	// Ids are handed out in order of first use | Components are copied with memcpy and saved as raw bytes
+	template<typename T>
+	uint32_t componentId() {
+		static_assert(std::is_trivially_copyable<T>::value, "Components must be trivially copyable");
+		static const uint32_t id = [] {
+			if (componentSizes().size() == MAX_COMPONENTS)
+				console::printError("ECS: Too many component types | A ComponentMask holds at most " + std::to_string(MAX_COMPONENTS), true);
+			componentSizes().push_back(sizeof(T));
+			return static_cast<uint32_t>(componentSizes().size() - 1);
+		}();
+		return id;
+	}
+
+	template<typename... Ts>
+	ComponentMask maskOf() {
+		ComponentMask mask = 0;
+		int expand[] = { 0, (mask |= 1u << componentId<Ts>(), 0)... };
+		(void)expand;
+		return mask;
+	}
+
+	// All entities with exactly one set of components | Row r of every column belongs to entities[r]
+	struct Archetype {
+		ComponentMask mask = 0;
+		std::vector<Entity> entities;
+		// One byte array per component in mask, ordered by id
+		std::vector<std::vector<unsigned char>> columns;
+		std::vector<uint32_t> sizes;
+		// Component id -> column | -1 if the archetype lacks the component
+		int8_t column[MAX_COMPONENTS];
+
+		Archetype(ComponentMask mask)
+			: mask(mask) {
+			for (uint32_t id = 0; id < MAX_COMPONENTS; ++id) {
+				column[id] = -1;
+				if (mask & (1u << id)) {
+					column[id] = static_cast<int8_t>(columns.size());
+					columns.emplace_back();
+					sizes.push_back(componentSizes()[id]);
+				}
+			}
+		}
+
+		size_t size() const {
+			return entities.size();
+		}
+
+		unsigned char* at(int c, size_t row) {
+			return columns[c].data() + row * sizes[c];
+		}
+
+		// Contiguous array of one component | Only valid until rows are added or removed
+		template<typename T>
+		T* data() {
+			return reinterpret_cast<T*>(columns[column[componentId<T>()]].data());
+		}
+
+		void reserve(size_t rows) {
+			entities.reserve(rows);
+			for (size_t c = 0; c < columns.size(); ++c)
+				columns[c].reserve(rows * sizes[c]);
+		}
+
+		// Appends an uninitialized row
+		uint32_t addRow(Entity entity) {
+			entities.push_back(entity);
+			for (size_t c = 0; c < columns.size(); ++c)
+				columns[c].resize(columns[c].size() + sizes[c]);
+			return static_cast<uint32_t>(entities.size() - 1);
+		}
+
+		// Moves the last row into row | Returns the entity that moved, NO_ENTITY if row was the last
+		Entity removeRow(uint32_t row) {
+			uint32_t last = static_cast<uint32_t>(entities.size() - 1);
+			Entity moved = NO_ENTITY;
+			if (row != last) {
+				moved = entities[last];
+				entities[row] = moved;
+				for (size_t c = 0; c < columns.size(); ++c)
+					std::memcpy(at(static_cast<int>(c), row), at(static_cast<int>(c), last), sizes[c]);
+			}
+			entities.pop_back();
+			for (size_t c = 0; c < columns.size(); ++c)
+				columns[c].resize(columns[c].size() - sizes[c]);
+			return moved;
+		}
+	};
+
+	// Owns all entities and their components
+	// Adding or removing components moves an entity between archetypes, so do it outside of each()
+	class Registry {
+	private:
+		static const uint32_t SLOT_BITS = 20;
+		static const uint32_t SLOT_MASK = (1 << SLOT_BITS) - 1;
+
+		// Archetypes are never removed, so indices into this stay valid
+		std::vector<Archetype> archetypes;
+		std::unordered_map<ComponentMask, uint32_t> archetypeIndex;
+
+		// Slot -> archetype and row of the entity using it
+		std::vector<uint32_t> slotArchetype;
+		std::vector<uint32_t> slotRow;
+		std::vector<uint32_t> slotGeneration;
+		std::vector<uint32_t> freeSlots;
+
+		static Entity makeEntity(uint32_t slot, uint32_t generation) {
+			return (generation << SLOT_BITS) | slot;
+		}
+
+		uint32_t findArchetype(ComponentMask mask) {
+			auto found = archetypeIndex.find(mask);
+			if (found != archetypeIndex.end())
+				return found->second;
+			archetypes.emplace_back(mask);
+			uint32_t index = static_cast<uint32_t>(archetypes.size() - 1);
+			archetypeIndex.emplace(mask, index);
+			return index;
+		}
+
+		// Takes the entity out of its row and fixes the row of the one that moved in
+		void leaveRow(uint32_t slot) {
+			Entity moved = archetypes[slotArchetype[slot]].removeRow(slotRow[slot]);
+			if (moved != NO_ENTITY)
+				slotRow[moved & SLOT_MASK] = slotRow[slot];
+		}
+
+		// Moves an entity to the archetype of mask | Components of both archetypes are copied over, new ones left uninitialized
+		void moveEntity(Entity entity, ComponentMask mask) {
+			uint32_t slot = entity & SLOT_MASK;
+			uint32_t to = findArchetype(mask);
+			// findArchetype may have grown the array, so the references are taken after it
+			Archetype& source = archetypes[slotArchetype[slot]];
+			Archetype& target = archetypes[to];
+			uint32_t row = target.addRow(entity);
+			for (uint32_t id = 0; id < MAX_COMPONENTS; ++id) {
+				if (source.column[id] >= 0 && target.column[id] >= 0)
+					std::memcpy(target.at(target.column[id], row), source.at(source.column[id], slotRow[slot]), target.sizes[target.column[id]]);
+			}
+			leaveRow(slot);
+			slotArchetype[slot] = to;
+			slotRow[slot] = row;
+		}
+
+		template<typename T>
+		void set(Archetype& a, uint32_t row, const T& value) {
+			std::memcpy(a.at(a.column[componentId<T>()], row), &value, sizeof(T));
+		}
+
+		template<typename F, typename... Ts>
+		static void eachRow(size_t count, const Entity* entities, F& func, Ts*... arrays) {
+			for (size_t row = 0; row < count; ++row)
+				func(entities[row], arrays[row]...);
+		}
+	public:
+		// Creates an entity with the given components
+		template<typename... Ts>
+		Entity create(const Ts&... components) {
+			uint32_t slot;
+			if (freeSlots.empty()) {
+				slot = static_cast<uint32_t>(slotArchetype.size());
+				slotArchetype.push_back(0);
+				slotRow.push_back(0);
+				slotGeneration.push_back(0);
+			}
+			else {
+				slot = freeSlots.back();
+				freeSlots.pop_back();
+			}
+			Entity entity = makeEntity(slot, slotGeneration[slot]);
+			uint32_t index = findArchetype(maskOf<Ts...>());
+			Archetype& a = archetypes[index];
+			uint32_t row = a.addRow(entity);
+			int expand[] = { 0, (set(a, row, components), 0)... };
+			(void)expand;
+			slotArchetype[slot] = index;
+			slotRow[slot] = row;
+			return entity;
+		}
+
+		// Room for count entities made of Ts | Creating and destroying up to that many allocates nothing
+		template<typename... Ts>
+		void reserve(size_t count) {
+			archetypes[findArchetype(maskOf<Ts...>())].reserve(count);
+			slotArchetype.reserve(count);
+			slotRow.reserve(count);
+			slotGeneration.reserve(count);
+			freeSlots.reserve(count);
+		}
+
+		void destroy(Entity entity) {
+			if (!alive(entity))
+				return;
+			uint32_t slot = entity & SLOT_MASK;
+			leaveRow(slot);
+			slotGeneration[slot] = (slotGeneration[slot] + 1) & (0xFFFFFFFF >> SLOT_BITS);
+			freeSlots.push_back(slot);
+		}
+
+		bool alive(Entity entity) const {
+			uint32_t slot = entity & SLOT_MASK;
+			return slot < slotGeneration.size() && slotGeneration[slot] == (entity >> SLOT_BITS);
+		}
+
+		size_t size() const {
+			return slotGeneration.size() - freeSlots.size();
+		}
+
+		template<typename T>
+		bool has(Entity entity) const {
+			return alive(entity) && archetypes[slotArchetype[entity & SLOT_MASK]].column[componentId<T>()] >= 0;
+		}
+
+		// Component of an entity | nullptr if it has none, only valid until components are added or removed
+		template<typename T>
+		T* get(Entity entity) {
+			if (!has<T>(entity))
+				return nullptr;
+			uint32_t slot = entity & SLOT_MASK;
+			return archetypes[slotArchetype[slot]].data<T>() + slotRow[slot];
+		}
+
+		// Adds a component or overwrites the one the entity has
+		template<typename T>
+		void add(Entity entity, const T& value) {
+			if (!alive(entity))
+				return;
+			uint32_t slot = entity & SLOT_MASK;
+			ComponentMask mask = archetypes[slotArchetype[slot]].mask | maskOf<T>();
+			if (mask != archetypes[slotArchetype[slot]].mask)
+				moveEntity(entity, mask);
+			set(archetypes[slotArchetype[slot]], slotRow[slot], value);
+		}
+
+		template<typename T>
+		void remove(Entity entity) {
+			if (!has<T>(entity))
+				return;
+			uint32_t slot = entity & SLOT_MASK;
+			moveEntity(entity, archetypes[slotArchetype[slot]].mask & ~maskOf<T>());
+		}
+
+		// Calls func(entity, Ts&...) for every entity having all of Ts
+		// Walks the matching archetypes one after another and their rows in order, the calls inline into the loop
+		template<typename... Ts, typename F>
+		void each(F func) {
+			ComponentMask need = maskOf<Ts...>();
+			for (Archetype& a : archetypes) {
+				if ((a.mask & need) == need && a.size() > 0)
+					eachRow(a.size(), a.entities.data(), func, a.data<Ts>()...);
+			}
+		}
+
+		// Number of entities having all of Ts
+		template<typename... Ts>
+		size_t count() {
+			ComponentMask need = maskOf<Ts...>();
+			size_t total = 0;
+			for (const Archetype& a : archetypes) {
+				if ((a.mask & need) == need)
+					total += a.size();
+			}
+			return total;
+		}
+
+		// Every archetype's rows and the entity slots | Archetypes created after a save are emptied on restore
+		void save(physics::StateBuffer& buffer) const {
+			buffer.write(archetypes.size());
+			for (const Archetype& a : archetypes) {
+				buffer.writeArray(a.entities);
+				for (const std::vector<unsigned char>& c : a.columns)
+					buffer.writeArray(c);
+			}
+			buffer.writeArray(slotArchetype);
+			buffer.writeArray(slotRow);
+			buffer.writeArray(slotGeneration);
+			buffer.writeArray(freeSlots);
+		}
+
+		void restore(physics::StateBuffer& buffer) {
+			size_t count;
+			buffer.read(count);
+			for (size_t i = 0; i < archetypes.size(); ++i) {
+				Archetype& a = archetypes[i];
+				if (i < count) {
+					buffer.readArray(a.entities);
+					for (std::vector<unsigned char>& c : a.columns)
+						buffer.readArray(c);
+				}
+				else {
+					a.entities.clear();
+					for (std::vector<unsigned char>& c : a.columns)
+						c.clear();
+				}
+			}
+			buffer.readArray(slotArchetype);
+			buffer.readArray(slotRow);
+			buffer.readArray(slotGeneration);
+			buffer.readArray(freeSlots);
+		}
+	};
+}
\ No newline at end of file
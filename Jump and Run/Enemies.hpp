@@ -0,0 +1,200 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "Map.hpp"
+#include "ECS.hpp"
+#include "Components.hpp"
+#include "AI.hpp"
+#include "Behavior.hpp"
+#include "Physics.hpp"
+
+
+// Thinking of the enemies | Kept apart from the physics and only talks to it through components
+namespace enemies {
+
+	// Leaves of walker behavior trees, in the order of walkerLeafNames
+	enum walkerLeaf : uint8_t {LEAF_PLAYER_WITHIN = 0, LEAF_CAN_SEE_PLAYER, LEAF_WALL_AHEAD, LEAF_ON_GROUND, LEAF_CHASE, LEAF_TURN, LEAF_WALK, LEAF_WAIT, LEAF_JUMP};
+
+	inline const std::vector<std::string>& walkerLeafNames() {
+		static const std::vector<std::string> names = { "playerWithin", "canSeePlayer", "wallAhead", "onGround", "chase", "turn", "walk", "wait", "jump" };
+		return names;
+	}
+
+	// Tree 0 of every WalkerSystem | Chases a player close by and in sight, otherwise turns at walls
+	const char* const WALKER_BEHAVIOR =
+		"(selector\n"
+		"	(sequence (playerWithin 8) (canSeePlayer) (chase))\n"
+		"	(sequence (wallAhead) (turn))\n"
+		"	(walk))";
+
+	// Senses and decisions of a batch of walkers | Index i of every array is the batch's i-th walker
+	struct WalkerBatch {
+		const gameMap::Map* map = nullptr;
+		glm::vec2 playerPos;
+		std::vector<glm::vec2> pos;
+		// Seconds since the walker last thought
+		std::vector<float> elapsed;
+		std::vector<uint8_t> wallAhead, onGround;
+		// Decisions | jump is the upward speed to jump with, 0 to stay
+		std::vector<float> direction, jump;
+		std::vector<behavior::AgentState> states;
+
+		void resize(size_t count) {
+			pos.resize(count);
+			elapsed.resize(count);
+			wallAhead.resize(count);
+			onGround.resize(count);
+			direction.resize(count);
+			jump.resize(count);
+			states.resize(count);
+		}
+
+		behavior::status operator()(uint8_t leaf, float arg, size_t i, float& timer) {
+			glm::vec2 toPlayer = playerPos - pos[i];
+			switch (leaf) {
+			case LEAF_PLAYER_WITHIN:
+				return glm::dot(toPlayer, toPlayer) < arg * arg ? behavior::SUCCESS : behavior::FAILURE;
+			case LEAF_CAN_SEE_PLAYER:
+				return ai::lineOfSight(*map, pos[i], playerPos) ? behavior::SUCCESS : behavior::FAILURE;
+			case LEAF_WALL_AHEAD:
+				return wallAhead[i] ? behavior::SUCCESS : behavior::FAILURE;
+			case LEAF_ON_GROUND:
+				return onGround[i] ? behavior::SUCCESS : behavior::FAILURE;
+			case LEAF_CHASE:
+				direction[i] = toPlayer.x < 0 ? -1.0f : 1.0f;
+				return behavior::SUCCESS;
+			case LEAF_TURN:
+				direction[i] = -direction[i];
+				return behavior::SUCCESS;
+			case LEAF_WAIT:
+				timer += elapsed[i];
+				return timer >= arg ? behavior::SUCCESS : behavior::RUNNING;
+			case LEAF_JUMP:
+				jump[i] = arg;
+				return behavior::SUCCESS;
+			default:
+				return behavior::SUCCESS;
+			}
+		}
+	};
+
+	// Walkers sense the world, run their behavior trees and leave the decision in their Walker component
+	// Reads the world and writes only components | Update it after every physics tick, the PhysicsHandler acts on the decisions on the next one
+	class WalkerSystem {
+	private:
+		ecs::Registry* registry;
+		physics::PhysicsHandler* physics;
+		ai::Scheduler brains;
+		// Behavior trees walkers can run | Tree 0 is WALKER_BEHAVIOR
+		std::vector<behavior::Program> trees;
+		// Scratch of think
+		struct Thinker {
+			ecs::Entity entity;
+			uint16_t tree, waited;
+		};
+		std::vector<Thinker> thinking;
+		WalkerBatch walkers;
+
+		// Whether tiles are within CONTACT_MARGIN beyond one face of a body | Contacts slow a body to a wall
+		// instead of letting the sweep hit it, so the tile grid is asked directly
+		static bool touchesTiles(const gameMap::Map& map, glm::vec2 pos, glm::vec2 halfExtents, int axis, int dir) {
+			physics::real min[2] = { physics::toReal(pos.x - halfExtents.x), physics::toReal(pos.y - halfExtents.y) };
+			physics::real max[2] = { physics::toReal(pos.x + halfExtents.x), physics::toReal(pos.y + halfExtents.y) };
+			physics::real gap;
+			return physics::probeFace(map, axis, min, max, dir, physics::CONTACT_MARGIN, gap) && gap <= physics::CONTACT_MARGIN;
+		}
+
+		// Walkers sharing a tree run as one batch
+		void think(const ecs::Entity* entities, const uint16_t* waited, size_t count, float dt) {
+			thinking.clear();
+			for (size_t k = 0; k < count; ++k) {
+				if (const behavior::AgentState* state = registry->get<behavior::AgentState>(entities[k]))
+					thinking.push_back({ entities[k], state->tree, waited[k] });
+			}
+			std::stable_sort(thinking.begin(), thinking.end(), [](const Thinker& a, const Thinker& b) {
+				return a.tree < b.tree;
+			});
+
+			const physics::World& world = physics->getWorld();
+			walkers.map = &world.getMap();
+			walkers.playerPos = physics->getPlayerPos();
+			walkers.resize(thinking.size());
+			for (size_t i = 0; i < thinking.size(); ++i) {
+				ecs::Entity e = thinking[i].entity;
+				const gameEntity::Runner& runner = *registry->get<gameEntity::Runner>(e);
+				float direction = registry->get<gameEntity::Walker>(e)->direction;
+				glm::vec2 pos = world.getPos(registry->get<gameEntity::PhysicsBody>(e)->handle);
+				walkers.pos[i] = pos;
+				walkers.elapsed[i] = thinking[i].waited * dt;
+				walkers.wallAhead[i] = touchesTiles(*walkers.map, pos, runner.halfExtents, 0, direction < 0 ? -1 : 1);
+				walkers.onGround[i] = touchesTiles(*walkers.map, pos, runner.halfExtents, 1, -1);
+				walkers.direction[i] = direction;
+				walkers.jump[i] = 0;
+				walkers.states[i] = *registry->get<behavior::AgentState>(e);
+			}
+
+			for (size_t begin = 0, end; begin < thinking.size(); begin = end) {
+				uint16_t tree = walkers.states[begin].tree;
+				for (end = begin + 1; end < thinking.size() && walkers.states[end].tree == tree; ++end) {}
+				behavior::runBatch(trees[tree], walkers.states.data(), begin, end, walkers);
+			}
+
+			for (size_t i = 0; i < thinking.size(); ++i) {
+				ecs::Entity e = thinking[i].entity;
+				gameEntity::Walker& walker = *registry->get<gameEntity::Walker>(e);
+				walker.direction = walkers.direction[i];
+				if (walkers.jump[i] > 0)
+					walker.jump = walkers.jump[i];
+				*registry->get<behavior::AgentState>(e) = walkers.states[i];
+			}
+		}
+	public:
+		WalkerSystem(ecs::Registry* registry, physics::PhysicsHandler* physics)
+			: registry(registry), physics(physics) {
+			uint16_t tree;
+			std::string error;
+			loadBehavior(WALKER_BEHAVIOR, tree, error);
+		}
+
+		// Decides whose turn it is | Set budgetMs to 0 where updates have to be reproducible
+		ai::Scheduler& getBrains() {
+			return brains;
+		}
+
+		// Compiles a walker behavior tree written with walkerLeafNames | False and error set if the text doesn't compile
+		bool loadBehavior(const std::string& text, uint16_t& tree, std::string& error) {
+			behavior::Program program;
+			if (!behavior::compile(text, walkerLeafNames(), program, error))
+				return false;
+			tree = static_cast<uint16_t>(trees.size());
+			trees.push_back(program);
+			return true;
+		}
+
+		// Enemy walking in direction (-1 or 1) as its behavior tree decides | tree comes from loadBehavior
+		ecs::Entity spawn(glm::vec2 pos, float direction, gameEntity::Runner runner = gameEntity::Runner(), uint16_t tree = 0) {
+			return physics->spawnWalker(pos, direction, runner, brains.makeBrain(), behavior::makeAgent(tree));
+		}
+
+		// Lets the walkers whose turn it is think | dt is the time since the last update, one scheduler tick
+		void update(float dt) {
+			glm::vec2 viewMin, viewMax;
+			physics->getView(viewMin, viewMax);
+			brains.update(*registry, viewMin, viewMax, [&](const ecs::Entity* entities, const uint16_t* waited, size_t count) {
+				think(entities, waited, count, dt);
+			});
+		}
+
+		// Brains and agent states are saved with the registry, this is the scheduler's bucket clock
+		void save(physics::StateBuffer& buffer) const {
+			brains.save(buffer);
+		}
+
+		void restore(physics::StateBuffer& buffer) {
+			brains.restore(buffer);
+		}
+	};
+}
\ No newline at end of file
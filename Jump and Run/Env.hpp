@@ -0,0 +1,157 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "Map.hpp"
+#include "Components.hpp"
+#include "Physics.hpp"
+#include "Collision.hpp"
+#include "Jobs.hpp"
+
+
+// Headless copies of the game for level tests and bot training | No GL context, no World, only the player's physics
+namespace env {
+
+	// Instances per task
+	const size_t ENV_BATCH = 1024;
+
+	// What an instance shows after a step | flags are physics::bodyFlags
+	struct Observation {
+		glm::vec2 pos, velocity;
+		uint8_t flags;
+		// Fell into the kill zone and went back to the spawn point this step
+		bool reset;
+	};
+
+	// Many independent players on one shared map, in structure-of-arrays form and stepped together
+	// A lone player needs no broadphase and its tile contacts never interact, so a step is the player's input, gravity,
+	// World's tile contact rules in closed form and the same tile sweep World uses
+	class VectorEnv {
+	private:
+		const gameMap::Map* map;
+		jobs::WorkerPool* pool;
+		physics::real dt;
+		physics::real halfW, halfH, runSpeed, gravityX, gravityY;
+		glm::vec2 spawn;
+
+		// Instance i of every array belongs to the same player
+		std::vector<physics::real> posX, posY, velX, velY;
+		std::vector<uint8_t> flags, reset;
+
+		void stepBatch(size_t begin, size_t end, const physics::movementX* actions, Observation* observations) {
+			using physics::real;
+			real* __restrict px = posX.data();
+			real* __restrict py = posY.data();
+			real* __restrict vx = velX.data();
+			real* __restrict vy = velY.data();
+			uint8_t* __restrict f = flags.data();
+			uint8_t* __restrict r = reset.data();
+			real gx = gravityX * dt, gy = gravityY * dt;
+
+			// The kill zone trigger sees players where the last step left them, as World's triggers do
+			real killMinX = physics::toReal(physics::KILL_ZONE_MIN.x), killMinY = physics::toReal(physics::KILL_ZONE_MIN.y);
+			real killMaxX = physics::toReal(physics::KILL_ZONE_MAX.x), killMaxY = physics::toReal(physics::KILL_ZONE_MAX.y);
+			for (size_t i = begin; i < end; ++i)
+				r[i] = px[i] - halfW < killMaxX && killMinX < px[i] + halfW && py[i] - halfH < killMaxY && killMinY < py[i] + halfH;
+
+			// Input and gravity | movementX is -1, 0 or 1, so it scales the run speed instead of choosing one per instance
+			for (size_t i = begin; i < end; ++i) {
+				vx[i] = runSpeed * real(static_cast<int>(actions[i])) + gx;
+				vy[i] += gy;
+			}
+
+			for (size_t i = begin; i < end; ++i) {
+				// Tile contacts as World's solver resolves them for a lone body | Approach is cut to the gap, penetration pushed out
+				real min[2] = { px[i] - halfW, py[i] - halfH };
+				real max[2] = { px[i] + halfW, py[i] + halfH };
+				real velocity[2] = { vx[i], vy[i] };
+				real push[2] = { real(0), real(0) };
+				for (int axis = 0; axis < 2; ++axis) {
+					for (int dir = -1; dir <= 1; dir += 2) {
+						real gap;
+						if (!physics::probeFace(*map, axis, min, max, dir, physics::CONTACT_MARGIN, gap))
+							continue;
+						real limit = gap > real(0) ? gap / dt : real(0);
+						if (velocity[axis] * real(dir) > limit)
+							velocity[axis] = limit * real(dir);
+						if (-gap > physics::CONTACT_SLOP)
+							push[axis] = -real(dir) * physics::BAUMGARTE * (-gap - physics::CONTACT_SLOP) / dt;
+					}
+				}
+				vx[i] = velocity[0];
+				vy[i] = velocity[1];
+
+				physics::SweepResult moved = physics::sweepBox(*map, px[i], py[i], halfW, halfH, (vx[i] + push[0]) * dt, (vy[i] + push[1]) * dt);
+				px[i] = moved.x;
+				py[i] = moved.y;
+				uint8_t hit = 0;
+				if (moved.hitX) {
+					vx[i] = real(0);
+					hit |= physics::BODY_HIT_WALL;
+				}
+				if (moved.hitY) {
+					hit |= vy[i] < real(0) ? physics::BODY_ON_GROUND : physics::BODY_HIT_CEILING;
+					vy[i] = real(0);
+				}
+				f[i] = hit;
+			}
+
+			// Kill zone | Selects instead of branches
+			real spawnX = physics::toReal(spawn.x), spawnY = physics::toReal(spawn.y);
+			for (size_t i = begin; i < end; ++i) {
+				bool dead = r[i] != 0;
+				px[i] = dead ? spawnX : px[i];
+				py[i] = dead ? spawnY : py[i];
+				vx[i] = dead ? real(0) : vx[i];
+				vy[i] = dead ? real(0) : vy[i];
+			}
+
+			for (size_t i = begin; i < end; ++i) {
+				Observation& o = observations[i];
+				o.pos = glm::vec2(physics::toFloat(px[i]), physics::toFloat(py[i]));
+				o.velocity = glm::vec2(physics::toFloat(vx[i]), physics::toFloat(vy[i]));
+				o.flags = f[i];
+				o.reset = r[i] != 0;
+			}
+		}
+	public:
+		// count players start at spawn | The map must not change while the environment uses it
+		// Size and speed are a default Runner's, gravity the World's default, as for the game's player
+		VectorEnv(const gameMap::Map* map, size_t count, glm::vec2 spawn, jobs::WorkerPool* pool = nullptr, float tickRate = physics::DEFAULT_TICK_RATE)
+			: map(map), pool(pool), dt(physics::toReal(1.0f / tickRate)), spawn(spawn),
+			posX(count), posY(count), velX(count), velY(count), flags(count), reset(count) {
+			gameEntity::Runner runner;
+			halfW = physics::toReal(runner.halfExtents.x);
+			halfH = physics::toReal(runner.halfExtents.y);
+			runSpeed = physics::toReal(runner.runSpeed);
+			gravityX = physics::toReal(physics::DEFAULT_GRAVITY.x);
+			gravityY = physics::toReal(physics::DEFAULT_GRAVITY.y);
+			for (size_t i = 0; i < count; ++i)
+				restart(i);
+		}
+
+		size_t size() const {
+			return posX.size();
+		}
+
+		// Puts one instance back to the spawn point
+		void restart(size_t i) {
+			posX[i] = physics::toReal(spawn.x);
+			posY[i] = physics::toReal(spawn.y);
+			velX[i] = velY[i] = physics::real(0);
+			flags[i] = 0;
+			reset[i] = 0;
+		}
+
+		// One tick of every instance | actions and observations hold size() entries, index i belongs to instance i
+		// Batches run on the pool if there is one | Results don't depend on the thread count
+		void step(const physics::movementX* actions, Observation* observations) {
+			auto batch = [&](size_t begin, size_t end) { stepBatch(begin, end, actions, observations); };
+			if (pool)
+				pool->parallelFor(size(), ENV_BATCH, batch);
+			else
+				for (size_t begin = 0; begin < size(); begin += ENV_BATCH)
+					batch(begin, std::min(size(), begin + ENV_BATCH));
+		}
+	};
+}
\ No newline at end of file
@@ -0,0 +1,170 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include "Jobs.hpp"
+
+
+// Gameplay events published from any thread of the worker pool and read in bulk once a frame is over
+// Every thread writes into a lane of its own, publishing is a store and a counter bump without locks or allocation
+namespace events {
+
+	// Events a channel holds per thread and frame | Events past it are counted in dropped
+	const size_t DEFAULT_CHANNEL_CAPACITY = 1024;
+
+	// Atomic since a type can first be asked for by publish, on any thread of the pool
+	inline std::atomic<uint32_t>& eventTypeCount() {
+		static std::atomic<uint32_t> count(0);
+		return count;
+	}
+
+	// Dense id per event type | Assigned the first time the type is asked for, usually when its channel is opened
+	template<typename T>
+	uint32_t eventTypeId() {
+		static const uint32_t id = eventTypeCount().fetch_add(1);
+		return id;
+	}
+
+	class ChannelBase {
+	public:
+		virtual ~ChannelBase() {}
+		virtual void setLanes(size_t lanes) = 0;
+		virtual void flush() = 0;
+	};
+
+	// Events of one type | Lane i is written by thread i of the pool only, so each lane has a single producer
+	// Lanes go by WorkerPool::threadIndex, which is the same for thread i of every pool, so only one pool may publish to a bus
+	template<typename T>
+	class Channel : public ChannelBase {
+	private:
+		// Counter of one lane, padded to a cache line so threads don't share one
+		struct Lane {
+			std::atomic<uint32_t> count;
+			char padding[64 - sizeof(std::atomic<uint32_t>)];
+
+			Lane()
+				: count(0) {}
+		};
+
+		size_t capacity;
+		size_t laneCount = 0;
+		std::unique_ptr<Lane[]> lanes;
+		// Lane i owns [i * capacity, (i + 1) * capacity)
+		std::vector<T> storage;
+		std::vector<T> merged;
+		std::atomic<uint32_t> droppedCount;
+	public:
+		// Events that didn't fit into their lane during the last frame
+		size_t dropped = 0;
+
+		Channel(size_t lanes, size_t capacity)
+			: capacity(capacity), droppedCount(0) {
+			setLanes(lanes);
+		}
+
+		// Drops the events published since the last flush
+		void setLanes(size_t count) override {
+			laneCount = count;
+			lanes.reset(new Lane[count]);
+			storage.assign(count * capacity, T());
+			merged.clear();
+			merged.reserve(count * capacity);
+		}
+
+		// Safe from every thread of the pool at the same time | False if the event was dropped
+		bool publish(const T& event) {
+			size_t lane = jobs::WorkerPool::threadIndex();
+			uint32_t n = lane < laneCount ? lanes[lane].count.load(std::memory_order_relaxed) : capacity;
+			if (n == capacity) {
+				droppedCount.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+			storage[lane * capacity + n] = event;
+			lanes[lane].count.store(n + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Makes the events of the ending frame readable | Lanes go one after another, each in publish order
+		void flush() override {
+			merged.clear();
+			for (size_t lane = 0; lane < laneCount; ++lane) {
+				uint32_t n = lanes[lane].count.load(std::memory_order_acquire);
+				merged.insert(merged.end(), storage.begin() + lane * capacity, storage.begin() + lane * capacity + n);
+				lanes[lane].count.store(0, std::memory_order_relaxed);
+			}
+			dropped = droppedCount.exchange(0);
+		}
+
+		// Events of the last frame | Valid until the next flush, the order across lanes depends on which thread ran what
+		const std::vector<T>& events() const {
+			return merged;
+		}
+	};
+
+	// Typed channels found by event type | Open every channel before publishing, opening allocates
+	class EventBus {
+	private:
+		std::vector<std::unique_ptr<ChannelBase>> channels;
+		size_t lanes;
+
+		template<typename T>
+		Channel<T>* find() const {
+			uint32_t id = eventTypeId<T>();
+			return id < channels.size() ? static_cast<Channel<T>*>(channels[id].get()) : nullptr;
+		}
+	public:
+		// lanes is the thread count of the pool publishing, 1 for a single thread
+		// Give every pool a bus of its own | Threads of two pools publishing to one bus would share lanes
+		EventBus(size_t lanes = 1)
+			: lanes(lanes) {}
+
+		// Drops the events published since the last flush
+		void setLanes(size_t count) {
+			lanes = count;
+			for (auto& channel : channels) {
+				if (channel)
+					channel->setLanes(lanes);
+			}
+		}
+
+		template<typename T>
+		Channel<T>& open(size_t capacity = DEFAULT_CHANNEL_CAPACITY) {
+			uint32_t id = eventTypeId<T>();
+			if (id >= channels.size())
+				channels.resize(id + 1);
+			if (!channels[id])
+				channels[id].reset(new Channel<T>(lanes, capacity));
+			return *static_cast<Channel<T>*>(channels[id].get());
+		}
+
+		// Events of types without a channel are ignored
+		template<typename T>
+		void publish(const T& event) {
+			if (Channel<T>* channel = find<T>())
+				channel->publish(event);
+		}
+
+		// Events of type T from the last frame | Empty if the type has no channel
+		template<typename T>
+		const std::vector<T>& read() const {
+			static const std::vector<T> none;
+			Channel<T>* channel = find<T>();
+			return channel ? channel->events() : none;
+		}
+
+		template<typename T>
+		size_t dropped() const {
+			Channel<T>* channel = find<T>();
+			return channel ? channel->dropped : 0;
+		}
+
+		// Frame boundary | No thread may publish while this runs
+		void flush() {
+			for (auto& channel : channels) {
+				if (channel)
+					channel->flush();
+			}
+		}
+	};
+}
\ No newline at end of file
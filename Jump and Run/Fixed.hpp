@@ -0,0 +1,111 @@
+#pragma once
+#include <cstdint>
+#include <cmath>
+
+
+// Define PHYSICS_FIXED_POINT in the project's preprocessor definitions to run the physics on Q16.16 numbers
+// Float physics is faster to write but differs across compilers and optimization levels, fixed point is bit exact everywhere
+namespace physics {
+
+	// Signed Q16.16 fixed point number | Range of about +-32768 with a resolution of 1/65536
+	struct Fixed {
+		static const int FRACTION_BITS = 16;
+		static const int32_t ONE = 1 << FRACTION_BITS;
+
+		int32_t raw = 0;
+
+		Fixed() = default;
+		constexpr Fixed(int v)
+			: raw(static_cast<int32_t>(static_cast<uint32_t>(v) << FRACTION_BITS)) {}
+		// Rounds to the nearest step | Same float in, same bits out on every build
+		constexpr explicit Fixed(float v)
+			: raw(static_cast<int32_t>(v * ONE + (v >= 0 ? 0.5f : -0.5f))) {}
+		constexpr explicit Fixed(double v)
+			: raw(static_cast<int32_t>(v * ONE + (v >= 0 ? 0.5 : -0.5))) {}
+
+		static constexpr Fixed fromRaw(int32_t raw) {
+			return Fixed(raw, 0);
+		}
+
+		explicit operator float() const {
+			return raw / static_cast<float>(ONE);
+		}
+
+		Fixed operator-() const { return fromRaw(-raw); }
+		Fixed operator+(Fixed o) const { return fromRaw(raw + o.raw); }
+		Fixed operator-(Fixed o) const { return fromRaw(raw - o.raw); }
+		Fixed operator*(Fixed o) const { return fromRaw(static_cast<int32_t>((static_cast<int64_t>(raw) * o.raw) >> FRACTION_BITS)); }
+		// Dividing by zero saturates towards the dividend's sign, where float mode gives an infinity
+		Fixed operator/(Fixed o) const {
+			if (o.raw == 0)
+				return fromRaw(raw < 0 ? INT32_MIN : INT32_MAX);
+			return fromRaw(static_cast<int32_t>((static_cast<int64_t>(raw) * ONE) / o.raw));
+		}
+
+		Fixed& operator+=(Fixed o) { raw += o.raw; return *this; }
+		Fixed& operator-=(Fixed o) { raw -= o.raw; return *this; }
+		Fixed& operator*=(Fixed o) { return *this = *this * o; }
+		Fixed& operator/=(Fixed o) { return *this = *this / o; }
+
+		bool operator==(Fixed o) const { return raw == o.raw; }
+		bool operator!=(Fixed o) const { return raw != o.raw; }
+		bool operator<(Fixed o) const { return raw < o.raw; }
+		bool operator>(Fixed o) const { return raw > o.raw; }
+		bool operator<=(Fixed o) const { return raw <= o.raw; }
+		bool operator>=(Fixed o) const { return raw >= o.raw; }
+
+	private:
+		constexpr Fixed(int32_t raw, int)
+			: raw(raw) {}
+	};
+
+	inline Fixed abs(Fixed v) {
+		return v.raw < 0 ? -v : v;
+	}
+
+	inline int floorToInt(Fixed v) {
+		return v.raw >> Fixed::FRACTION_BITS;
+	}
+
+	inline int ceilToInt(Fixed v) {
+		return (v.raw + Fixed::ONE - 1) >> Fixed::FRACTION_BITS;
+	}
+
+	inline int floorToInt(float v) {
+		return static_cast<int>(std::floor(v));
+	}
+
+	inline int ceilToInt(float v) {
+		return static_cast<int>(std::ceil(v));
+	}
+
+	inline float abs(float v) {
+		return std::abs(v);
+	}
+
+	// Fixed point numbers are always finite
+	inline bool isFinite(Fixed) {
+		return true;
+	}
+
+	inline bool isFinite(float v) {
+		return std::isfinite(v);
+	}
+
+	// Number type of all simulation state | Gameplay code talks to the physics in floats
+#ifdef PHYSICS_FIXED_POINT
+	typedef Fixed real;
+	const char* const NUMERIC_MODE = "fixed";
+#else
+	typedef float real;
+	const char* const NUMERIC_MODE = "float";
+#endif
+
+	inline constexpr real toReal(float v) {
+		return real(v);
+	}
+
+	inline float toFloat(real v) {
+		return static_cast<float>(v);
+	}
+}
\ No newline at end of file
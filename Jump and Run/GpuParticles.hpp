@@ -0,0 +1,386 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <random>
+#include <cstdint>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include <own/renderutil.hpp>
+#include "Map.hpp"
+#include "Particles.hpp"
+
+
+namespace particles {
+
+	// One particle as the GPU keeps it | The first half is the instance particle.vert draws, so drawing reads the simulation buffer as it is
+	struct GpuParticle {
+		ParticleInstance instance;
+		float velX, velY, age, invLife;
+	};
+
+	// Particles that never leave the GPU | A vertex shader moves every particle from one buffer into the other by transform feedback
+	// and the draw reads the buffer it wrote, so a frame only uploads the particles spawned since the last one
+	// Each material keeps its particles in a ring of capacity slots | Spawns append to the live window of the ring and the oldest slots leave it once
+	// their particle expired, so update and draw only run over the window | A particle dying early stays in it, skipped by the shader and drawn as nothing
+	class GpuParticleSystem {
+	private:
+		struct Pool {
+			Material kind;
+			uint32_t capacity;
+			// Oldest slot of the live window and how many slots it spans, pending ones included
+			uint32_t tail = 0, live = 0;
+			// Slot of the first pending spawn
+			uint32_t pendingSlot = 0;
+			// Buffer of the pair holding the latest state | The update reads it and writes the other one
+			uint32_t current = 0;
+			GLuint buffers[2] = { 0, 0 };
+			// Per buffer, one to read it for the update and one to draw it as instances
+			GLuint updateVao[2] = { 0, 0 }, drawVao[2] = { 0, 0 };
+			// Spawned since the last update, written into the ring before the next one
+			std::vector<GpuParticle> pending;
+			// Time at which the particle of each slot dies | Kept on the CPU to shrink the window without reading anything back
+			std::vector<float> expiry;
+
+			// The window as at most two ranges of slots, the second one if it wraps around the end of the ring
+			uint32_t ranges(uint32_t first[2], uint32_t count[2]) const {
+				first[0] = tail;
+				count[0] = std::min(live, capacity - tail);
+				first[1] = 0;
+				count[1] = live - count[0];
+				return count[1] > 0 ? 2 : count[0] > 0 ? 1 : 0;
+			}
+		};
+
+		const gameMap::Map* map;
+		std::vector<Pool> pools;
+		std::vector<Emitter> emitters;
+		std::minstd_rand random;
+		std::uniform_real_distribution<float> unit;
+		// Seconds the system has been updated for
+		float clock = 0;
+
+		GLuint updateProgram = 0;
+		renderUtil::ShaderEngine drawShader;
+		GLuint quad = 0, tiles = 0;
+
+		float randomIn(float spread) {
+			return (unit(random) * 2.0f - 1.0f) * spread;
+		}
+
+		void spawnEmitted(float dt) {
+			for (Emitter& e : emitters) {
+				if (e.rate <= 0)
+					continue;
+				e.owed += e.rate * dt;
+				for (; e.owed >= 1.0f; e.owed -= 1.0f)
+					spawn(e.material, e.pos, e.velocity + glm::vec2(randomIn(e.spread.x), randomIn(e.spread.y)), e.lifetime);
+			}
+		}
+
+		// Vertex shader only | The varyings have to be named before linking, which ShaderEngine doesn't leave room for
+		static GLuint buildUpdateProgram(const std::string& path) {
+			std::string code;
+			std::ifstream file;
+			try {
+				file.open(path);
+				std::stringstream text;
+				text << file.rdbuf();
+				code = text.str();
+			}
+			catch (const std::ifstream::failure&) {
+				console::printError("GpuParticleSystem: Opening File failed | [" + path + "]");
+			}
+			const char* source = code.c_str();
+
+			GLuint shader = glCreateShader(GL_VERTEX_SHADER);
+			glShaderSource(shader, 1, &source, NULL);
+			glCompileShader(shader);
+
+			int success;
+			char infoLog[512];
+			glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+			if (!success) {
+				glGetShaderInfoLog(shader, 512, NULL, infoLog);
+				console::printError("GpuParticleSystem: Compiling Update Shader failed | Error Code:" + std::string(infoLog) + " | [" + path + "]");
+			}
+
+			GLuint program = glCreateProgram();
+			glAttachShader(program, shader);
+			const char* varyings[] = { "instance", "motion" };
+			glTransformFeedbackVaryings(program, 2, varyings, GL_INTERLEAVED_ATTRIBS);
+			glLinkProgram(program);
+			glGetProgramiv(program, GL_LINK_STATUS, &success);
+			if (!success) {
+				glGetProgramInfoLog(program, 512, NULL, infoLog);
+				console::printError("GpuParticleSystem: Linking Update Program failed | Error Code: " + std::string(infoLog));
+			}
+			glDeleteShader(shader);
+			return program;
+		}
+
+		GLint uniform(const char* name) const {
+			return glGetUniformLocation(updateProgram, name);
+		}
+
+		// Slots whose particle expired by the last update leave the window | Expiry order is spawn order for equal lifetimes, close to it otherwise
+		void shrink(Pool& pool) {
+			while (pool.live > pool.pending.size() && pool.expiry[pool.tail] <= clock) {
+				pool.tail = (pool.tail + 1) % pool.capacity;
+				--pool.live;
+			}
+		}
+
+		// Writes the pending spawns into their slots of the current buffer | One upload, two if the ring wraps
+		void inject(Pool& pool) {
+			if (pool.pending.empty())
+				return;
+			// More spawns than slots overwrote each other, only the newest capacity of them land | spawn counted the others
+			if (pool.pending.size() > pool.capacity) {
+				uint32_t skipped = static_cast<uint32_t>(pool.pending.size() - pool.capacity);
+				pool.pending.erase(pool.pending.begin(), pool.pending.begin() + skipped);
+				pool.pendingSlot = (pool.pendingSlot + skipped) % pool.capacity;
+			}
+
+			glBindBuffer(GL_ARRAY_BUFFER, pool.buffers[pool.current]);
+			size_t first = 0;
+			while (first < pool.pending.size()) {
+				size_t amount = std::min<size_t>(pool.pending.size() - first, pool.capacity - pool.pendingSlot);
+				glBufferSubData(GL_ARRAY_BUFFER, pool.pendingSlot * sizeof(GpuParticle), amount * sizeof(GpuParticle), pool.pending.data() + first);
+				first += amount;
+				pool.pendingSlot = static_cast<uint32_t>((pool.pendingSlot + amount) % pool.capacity);
+			}
+			uploaded += pool.pending.size() * sizeof(GpuParticle);
+			pool.pending.clear();
+		}
+
+		void advance(Pool& pool, float dt) {
+			const Material& kind = pool.kind;
+			glUniform1f(uniform("fall"), gravity.y * kind.gravityScale * dt);
+			glUniform1f(uniform("keep"), std::max(1.0f - kind.drag * dt, 0.0f));
+			glUniform1f(uniform("startSize"), kind.startSize);
+			glUniform1f(uniform("grow"), kind.endSize - kind.startSize);
+			glUniform1i(uniform("collides"), kind.collides);
+
+			// Each range lands at the same slots of the other buffer | Slots outside the window are left stale, nobody reads them
+			uint32_t next = 1 - pool.current;
+			uint32_t first[2], count[2];
+			uint32_t ranges = pool.ranges(first, count);
+			glBindVertexArray(pool.updateVao[pool.current]);
+			for (uint32_t r = 0; r < ranges; ++r) {
+				glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, pool.buffers[next], first[r] * sizeof(GpuParticle), count[r] * sizeof(GpuParticle));
+				glBeginTransformFeedback(GL_POINTS);
+				glDrawArrays(GL_POINTS, first[r], count[r]);
+				glEndTransformFeedback();
+			}
+			pool.current = next;
+		}
+	public:
+		glm::vec2 gravity = physics::DEFAULT_GRAVITY;
+		// Spawns that took the slot of a particle still alive since the system was created
+		size_t dropped = 0;
+		// Bytes of spawned particles sent to the GPU since the system was created | The only upload of a frame
+		size_t uploaded = 0;
+
+		// Needs a current GL 3.3 context | The map's solid cells are uploaded once, call uploadTiles after changing them
+		GpuParticleSystem(const gameMap::Map* map, unsigned int seed = 1,
+			const std::string& updatePath = "particle_update.vert", const std::string& vertexPath = "particle.vert", const std::string& fragmentPath = "particle.frag")
+			: map(map), random(seed), unit(0.0f, 1.0f), drawShader(vertexPath, fragmentPath) {
+			updateProgram = buildUpdateProgram(updatePath);
+			const float corners[] = { -0.5f, -0.5f, 0.5f, -0.5f, -0.5f, 0.5f, 0.5f, 0.5f };
+			glGenBuffers(1, &quad);
+			glBindBuffer(GL_ARRAY_BUFFER, quad);
+			glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+			glGenTextures(1, &tiles);
+			uploadTiles();
+		}
+
+		~GpuParticleSystem() {
+			for (Pool& pool : pools) {
+				glDeleteVertexArrays(2, pool.updateVao);
+				glDeleteVertexArrays(2, pool.drawVao);
+				glDeleteBuffers(2, pool.buffers);
+			}
+			glDeleteTextures(1, &tiles);
+			glDeleteBuffers(1, &quad);
+			glDeleteProgram(updateProgram);
+		}
+
+		GpuParticleSystem(const GpuParticleSystem&) = delete;
+		GpuParticleSystem& operator=(const GpuParticleSystem&) = delete;
+
+		// One byte per cell | Cells outside the grid are never solid, the shader checks the bounds itself
+		void uploadTiles() {
+			glm::uvec2 grid = map->gridSize();
+			std::vector<uint8_t> solid(grid.x * grid.y);
+			for (unsigned int y = 0; y < grid.y; ++y) {
+				for (unsigned int x = 0; x < grid.x; ++x)
+					solid[y * grid.x + x] = map->isSolid(x, y) ? 255 : 0;
+			}
+			glActiveTexture(GL_TEXTURE1);
+			glBindTexture(GL_TEXTURE_2D, tiles);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, grid.x, grid.y, 0, GL_RED, GL_UNSIGNED_BYTE, solid.data());
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glActiveTexture(GL_TEXTURE0);
+		}
+
+		// capacity is the most particles of the material alive at once | Allocates both buffers of the pair up front
+		MaterialId addMaterial(const Material& kind, size_t capacity = DEFAULT_PARTICLE_CAPACITY) {
+			pools.emplace_back();
+			Pool& pool = pools.back();
+			pool.kind = kind;
+			pool.capacity = static_cast<uint32_t>(capacity);
+			pool.expiry.resize(capacity, 0.0f);
+
+			glGenBuffers(2, pool.buffers);
+			glGenVertexArrays(2, pool.updateVao);
+			glGenVertexArrays(2, pool.drawVao);
+			for (int b = 0; b < 2; ++b) {
+				glBindBuffer(GL_ARRAY_BUFFER, pool.buffers[b]);
+				glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(GpuParticle), nullptr, GL_DYNAMIC_COPY);
+
+				glBindVertexArray(pool.updateVao[b]);
+					glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(GpuParticle), (void*)0);
+					glEnableVertexAttribArray(0);
+					glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(GpuParticle), (void*)sizeof(ParticleInstance));
+					glEnableVertexAttribArray(1);
+
+				glBindVertexArray(pool.drawVao[b]);
+					glBindBuffer(GL_ARRAY_BUFFER, quad);
+					glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+					glEnableVertexAttribArray(0);
+					glBindBuffer(GL_ARRAY_BUFFER, pool.buffers[b]);
+					glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(GpuParticle), (void*)0);
+					glVertexAttribDivisor(1, 1);
+					glEnableVertexAttribArray(1);
+			}
+			glBindVertexArray(0);
+			return static_cast<MaterialId>(pools.size() - 1);
+		}
+
+		size_t materialCount() const {
+			return pools.size();
+		}
+
+		const Material& getMaterial(MaterialId m) const {
+			return pools[m].kind;
+		}
+
+		// Index of the emitter | Stays valid, set its rate to 0 to stop it
+		size_t addEmitter(const Emitter& emitter) {
+			emitters.push_back(emitter);
+			return emitters.size() - 1;
+		}
+
+		Emitter& getEmitter(size_t emitter) {
+			return emitters[emitter];
+		}
+
+		// Queued on the CPU and uploaded by the next update
+		void spawn(MaterialId m, glm::vec2 pos, glm::vec2 velocity, float lifetime) {
+			Pool& pool = pools[m];
+			uint32_t slot = (pool.tail + pool.live) % pool.capacity;
+			if (pool.pending.empty())
+				pool.pendingSlot = slot;
+			// A full ring gives up its oldest slot
+			if (pool.live == pool.capacity) {
+				dropped += pool.expiry[slot] > clock;
+				pool.tail = (pool.tail + 1) % pool.capacity;
+			}
+			else {
+				++pool.live;
+			}
+			pool.expiry[slot] = clock + lifetime;
+
+			GpuParticle p;
+			p.instance = { pos.x, pos.y, pool.kind.startSize, 1.0f };
+			p.velX = velocity.x;
+			p.velY = velocity.y;
+			p.age = 0.0f;
+			p.invLife = 1.0f / lifetime;
+			pool.pending.push_back(p);
+		}
+
+		// amount particles at pos going velocity plus up to spread per axis | Lifetimes vary by a quarter around lifetime
+		void burst(MaterialId m, glm::vec2 pos, glm::vec2 velocity, glm::vec2 spread, float lifetime, size_t amount) {
+			for (size_t k = 0; k < amount; ++k)
+				spawn(m, pos, velocity + glm::vec2(randomIn(spread.x), randomIn(spread.y)), lifetime * (1.0f + randomIn(0.25f)));
+		}
+
+		// Emits, uploads the new particles, then moves and ages every slot of the window by dt on the GPU
+		// Nothing is drawn and nothing is read back, the results stay in the buffers for draw
+		void update(float dt) {
+			for (Pool& pool : pools)
+				shrink(pool);
+			spawnEmitted(dt);
+			clock += dt;
+
+			glUseProgram(updateProgram);
+			glUniform1f(uniform("dt"), dt);
+			glUniform1f(uniform("bounce"), PARTICLE_BOUNCE);
+			glUniform1f(uniform("friction"), PARTICLE_FRICTION);
+			// The tiles live on unit 1, so the textures the sprites bind to unit 0 stay where they are
+			glUniform1i(uniform("tiles"), 1);
+			glActiveTexture(GL_TEXTURE1);
+			glBindTexture(GL_TEXTURE_2D, tiles);
+			glActiveTexture(GL_TEXTURE0);
+
+			glEnable(GL_RASTERIZER_DISCARD);
+			for (Pool& pool : pools) {
+				inject(pool);
+				if (pool.live > 0)
+					advance(pool, dt);
+			}
+			glDisable(GL_RASTERIZER_DISCARD);
+			glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+			glBindVertexArray(0);
+		}
+
+		// Draws every material's window straight from the buffer the last update wrote | One instanced draw per material, two if its window wraps
+		void draw(const glm::mat4& projection, const glm::mat4& view) {
+			drawShader.use();
+			drawShader.setMat4("projection", projection);
+			drawShader.setMat4("view", view);
+			glEnable(GL_BLEND);
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			for (const Pool& pool : pools) {
+				uint32_t first[2], count[2];
+				uint32_t ranges = pool.ranges(first, count);
+				if (ranges == 0)
+					continue;
+				drawShader.setVec4("color", pool.kind.color);
+				glBindVertexArray(pool.drawVao[pool.current]);
+				glBindBuffer(GL_ARRAY_BUFFER, pool.buffers[pool.current]);
+				for (uint32_t r = 0; r < ranges; ++r) {
+					// GL 3.3 has no base instance, so the instance attribute starts at the range instead
+					glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(GpuParticle), (void*)(first[r] * sizeof(GpuParticle)));
+					glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count[r]);
+				}
+			}
+			glBindVertexArray(0);
+			glDisable(GL_BLEND);
+		}
+
+		// Slots of material m the update and draw run over, counting spawns not uploaded yet
+		uint32_t windowSize(MaterialId m) const {
+			return pools[m].live;
+		}
+
+		// Copies the window of material m back from the GPU, oldest first | Waits for the GPU to finish, meant for tests and benchmarks
+		// Spawns since the last update aren't on the GPU yet and come out as whatever their slots held before
+		std::vector<GpuParticle> readBack(MaterialId m) const {
+			const Pool& pool = pools[m];
+			std::vector<GpuParticle> result(pool.live);
+			uint32_t first[2], count[2];
+			uint32_t ranges = pool.ranges(first, count);
+			glBindBuffer(GL_ARRAY_BUFFER, pool.buffers[pool.current]);
+			for (uint32_t r = 0, at = 0; r < ranges; at += count[r++])
+				glGetBufferSubData(GL_ARRAY_BUFFER, first[r] * sizeof(GpuParticle), count[r] * sizeof(GpuParticle), result.data() + at);
+			return result;
+		}
+	};
+}
\ No newline at end of file
@@ -0,0 +1,388 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <initializer_list>
+#include <algorithm>
+#include <cstdint>
+#include <own/helper.hpp>
+
+
+namespace jobs {
+
+	// What one thread did since the last takeStats
+	struct WorkerStats {
+		// Time spent inside tasks, including waits for tasks they spawned
+		float busyMs = 0;
+		uint32_t tasks = 0;
+		// Tasks taken from another thread's queue
+		uint32_t steals = 0;
+	};
+
+	// Tasks spawned together | WorkerPool::wait returns once all of them finished
+	class TaskGroup {
+	private:
+		friend class WorkerPool;
+		std::atomic<size_t> pending;
+	public:
+		TaskGroup()
+			: pending(0) {}
+
+		bool done() const {
+			return pending.load(std::memory_order_acquire) == 0;
+		}
+	};
+
+	// Fixed set of worker threads with one task queue each | The calling thread is thread 0 and works along while it waits
+	// A thread runs its own newest task first and, when out of work, steals the oldest task of another thread
+	// Tasks may spawn and wait for tasks of their own, waiting threads keep running tasks so nothing deadlocks
+	class WorkerPool {
+	private:
+		struct Task {
+			void (*run)(void* context, size_t index);
+			void* context;
+			size_t index;
+			TaskGroup* group;
+		};
+
+		// Ring of tasks | The owner pushes and pops at the back, thieves take from the front
+		struct TaskQueue {
+			std::mutex mutex;
+			std::vector<Task> ring = std::vector<Task>(64);
+			size_t head = 0, count = 0;
+
+			std::atomic<uint64_t> busyNs;
+			std::atomic<uint32_t> tasks, steals;
+
+			TaskQueue()
+				: busyNs(0), tasks(0), steals(0) {}
+
+			// Caller holds the mutex | Only grows, so a warmed up queue never allocates
+			void push(const Task& task) {
+				if (count == ring.size()) {
+					std::vector<Task> grown(ring.size() * 2);
+					for (size_t i = 0; i < count; ++i)
+						grown[i] = ring[(head + i) % ring.size()];
+					ring.swap(grown);
+					head = 0;
+				}
+				ring[(head + count++) % ring.size()] = task;
+			}
+
+			bool popBack(Task& task) {
+				std::lock_guard<std::mutex> lock(mutex);
+				if (count == 0)
+					return false;
+				task = ring[(head + --count) % ring.size()];
+				return true;
+			}
+
+			bool popFront(Task& task) {
+				std::lock_guard<std::mutex> lock(mutex);
+				if (count == 0)
+					return false;
+				task = ring[head];
+				head = (head + 1) % ring.size();
+				--count;
+				return true;
+			}
+		};
+
+		std::vector<std::thread> workers;
+		std::vector<std::unique_ptr<TaskQueue>> queues;
+
+		// Sleeping workers wait here while no thread has a task queued
+		std::mutex sleepMutex;
+		std::condition_variable wakeWorkers;
+		std::atomic<size_t> queued;
+		std::atomic<size_t> sleeping;
+		bool stopping = false;
+
+		struct ThreadSlot {
+			const WorkerPool* pool = nullptr;
+			size_t index = 0;
+			// Tasks this thread is inside of | Only the outermost one counts as busy time
+			int depth = 0;
+		};
+
+		static ThreadSlot& threadSlot() {
+			static thread_local ThreadSlot slot;
+			return slot;
+		}
+
+		// Queue of the calling thread | Threads outside the pool share queue 0 with the thread that created it
+		size_t currentQueue() const {
+			const ThreadSlot& slot = threadSlot();
+			return slot.pool == this ? slot.index : 0;
+		}
+
+		void wake(size_t tasks) {
+			if (sleeping.load() == 0)
+				return;
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			if (tasks == 1)
+				wakeWorkers.notify_one();
+			else
+				wakeWorkers.notify_all();
+		}
+
+		// Own queue first, then the others starting after it
+		bool findTask(size_t self, Task& task) {
+			if (queues[self]->popBack(task))
+				return true;
+			for (size_t k = 1; k < queues.size(); ++k) {
+				if (queues[(self + k) % queues.size()]->popFront(task)) {
+					queues[self]->steals.fetch_add(1, std::memory_order_relaxed);
+					return true;
+				}
+			}
+			return false;
+		}
+
+		void execute(size_t self, const Task& task) {
+			queued.fetch_sub(1);
+			ThreadSlot& slot = threadSlot();
+			if (slot.depth++ == 0) {
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				task.run(task.context, task.index);
+				queues[self]->busyNs.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(), std::memory_order_relaxed);
+			}
+			else {
+				task.run(task.context, task.index);
+			}
+			--slot.depth;
+			queues[self]->tasks.fetch_add(1, std::memory_order_relaxed);
+			task.group->pending.fetch_sub(1, std::memory_order_release);
+		}
+
+		void workerLoop(size_t self) {
+			ThreadSlot& slot = threadSlot();
+			slot.pool = this;
+			slot.index = self;
+			Task task;
+			while (true) {
+				if (findTask(self, task)) {
+					execute(self, task);
+					continue;
+				}
+				std::unique_lock<std::mutex> lock(sleepMutex);
+				sleeping.fetch_add(1);
+				wakeWorkers.wait(lock, [&] { return stopping || queued.load() > 0; });
+				sleeping.fetch_sub(1);
+				if (stopping)
+					return;
+			}
+		}
+
+		static void runFunction(void* context, size_t index) {
+			(*static_cast<const std::function<void(size_t)>*>(context))(index);
+		}
+	public:
+		// threads includes the calling thread | 0 picks one per hardware thread
+		WorkerPool(unsigned int threads = 0)
+			: queued(0), sleeping(0) {
+			if (threads == 0)
+				threads = std::max(1u, std::thread::hardware_concurrency());
+			for (unsigned int i = 0; i < threads; ++i)
+				queues.emplace_back(new TaskQueue());
+			ThreadSlot& slot = threadSlot();
+			slot.pool = this;
+			slot.index = 0;
+			for (unsigned int i = 1; i < threads; ++i)
+				workers.emplace_back(&WorkerPool::workerLoop, this, i);
+		}
+
+		~WorkerPool() {
+			{
+				std::lock_guard<std::mutex> lock(sleepMutex);
+				stopping = true;
+			}
+			wakeWorkers.notify_all();
+			for (auto& w : workers)
+				w.join();
+		}
+
+		size_t threadCount() const {
+			return workers.size() + 1;
+		}
+
+		// Index of the calling thread in the pool it works for | 0 for threads outside every pool
+		// Doesn't say which pool, thread 1 of one pool and thread 1 of another both get 1
+		static size_t threadIndex() {
+			return threadSlot().index;
+		}
+
+		// Queues run(context, index) on the calling thread | Other threads steal it if they run dry
+		void spawn(TaskGroup& group, void (*run)(void*, size_t), void* context, size_t index = 0) {
+			group.pending.fetch_add(1);
+			queued.fetch_add(1);
+			TaskQueue& queue = *queues[currentQueue()];
+			{
+				std::lock_guard<std::mutex> lock(queue.mutex);
+				queue.push({ run, context, index, &group });
+			}
+			wake(1);
+		}
+
+		// Runs tasks, the group's or any other, until every task of the group finished
+		void wait(TaskGroup& group) {
+			size_t self = currentQueue();
+			Task task;
+			while (!group.done()) {
+				if (findTask(self, task))
+					execute(self, task);
+				else
+					std::this_thread::yield();
+			}
+		}
+
+		// Runs task(i) for every i in [0, count) and returns once all of them finished
+		void run(size_t count, const std::function<void(size_t)>& job) {
+			if (workers.empty() || count <= 1) {
+				for (size_t i = 0; i < count; ++i)
+					job(i);
+				return;
+			}
+
+			TaskGroup group;
+			group.pending.fetch_add(count);
+			queued.fetch_add(count);
+			TaskQueue& queue = *queues[currentQueue()];
+			{
+				// Highest index first, so the owner starts at 0 while thieves take from the end
+				std::lock_guard<std::mutex> lock(queue.mutex);
+				for (size_t i = count; i-- > 0;)
+					queue.push({ &WorkerPool::runFunction, const_cast<std::function<void(size_t)>*>(&job), i, &group });
+			}
+			wake(count);
+			wait(group);
+		}
+
+		// Splits [0, count) into batches of batchSize and runs func(begin, end) on each
+		// Batch boundaries only depend on count and batchSize, never on the number of threads
+		template<typename F>
+		void parallelFor(size_t count, size_t batchSize, F func) {
+			size_t batches = (count + batchSize - 1) / batchSize;
+			run(batches, [&](size_t b) {
+				func(b * batchSize, std::min(count, (b + 1) * batchSize));
+			});
+		}
+
+		// Per thread counters since the last call, thread 0 first | Resets them
+		std::vector<WorkerStats> takeStats() {
+			std::vector<WorkerStats> result(queues.size());
+			for (size_t i = 0; i < queues.size(); ++i) {
+				result[i].busyMs = queues[i]->busyNs.exchange(0) / 1e6f;
+				result[i].tasks = queues[i]->tasks.exchange(0);
+				result[i].steals = queues[i]->steals.exchange(0);
+			}
+			return result;
+		}
+	};
+
+	// Systems of a frame and the data each reads and writes | Systems that don't conflict run in parallel
+	// A system waits for every earlier one that writes what it reads or writes, or reads what it writes,
+	// so every run gives the same result as calling the systems one after another in the order they were added
+	class FrameGraph {
+	private:
+		struct System {
+			std::string name;
+			uint64_t reads, writes;
+			std::function<void()> run;
+			// Later systems waiting for this one
+			std::vector<uint32_t> dependents;
+			uint32_t dependencies = 0;
+			float ms = 0;
+		};
+
+		// One bit per resource name, at most 64
+		std::vector<std::string> resources;
+		std::vector<System> systems;
+		std::unique_ptr<std::atomic<uint32_t>[]> waiting;
+
+		// Set during run
+		WorkerPool* pool = nullptr;
+		TaskGroup* group = nullptr;
+
+		uint64_t maskOf(std::initializer_list<std::string> names) {
+			uint64_t mask = 0;
+			for (const std::string& name : names) {
+				size_t bit = std::find(resources.begin(), resources.end(), name) - resources.begin();
+				if (bit == resources.size()) {
+					if (resources.size() == 64)
+						console::printError("FrameGraph: Too many resources | A mask holds at most 64 names, \"" + name + "\" is the 65th", true);
+					resources.push_back(name);
+				}
+				mask |= uint64_t(1) << bit;
+			}
+			return mask;
+		}
+
+		// Runs one system and queues the dependents it was the last to wait for
+		static void runSystem(void* context, size_t index) {
+			FrameGraph& graph = *static_cast<FrameGraph*>(context);
+			System& system = graph.systems[index];
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			system.run();
+			system.ms = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() / 1e6f;
+			for (uint32_t d : system.dependents) {
+				if (graph.waiting[d].fetch_sub(1) == 1)
+					graph.pool->spawn(*graph.group, &FrameGraph::runSystem, &graph, d);
+			}
+		}
+	public:
+		// Adds a system after all earlier ones | Resources are free names, shared between systems by name
+		size_t add(const std::string& name, std::initializer_list<std::string> reads, std::initializer_list<std::string> writes, std::function<void()> run) {
+			System system;
+			system.name = name;
+			system.reads = maskOf(reads);
+			system.writes = maskOf(writes);
+			system.run = run;
+			uint32_t index = static_cast<uint32_t>(systems.size());
+			for (System& earlier : systems) {
+				bool conflict = (earlier.writes & (system.reads | system.writes)) || (earlier.reads & system.writes);
+				if (conflict) {
+					earlier.dependents.push_back(index);
+					++system.dependencies;
+				}
+			}
+			systems.push_back(system);
+			waiting.reset(new std::atomic<uint32_t>[systems.size()]);
+			return index;
+		}
+
+		size_t size() const {
+			return systems.size();
+		}
+
+		const std::string& name(size_t system) const {
+			return systems[system].name;
+		}
+
+		// Milliseconds the system took in the last run
+		float lastMs(size_t system) const {
+			return systems[system].ms;
+		}
+
+		// Runs every system once | The calling thread helps until all of them finished
+		void run(WorkerPool& workerPool) {
+			pool = &workerPool;
+			TaskGroup frame;
+			group = &frame;
+			for (size_t i = 0; i < systems.size(); ++i)
+				waiting[i] = systems[i].dependencies;
+			for (size_t i = 0; i < systems.size(); ++i) {
+				if (systems[i].dependencies == 0)
+					pool->spawn(frame, &FrameGraph::runSystem, this, i);
+			}
+			pool->wait(frame);
+			group = nullptr;
+		}
+	};
+}
\ No newline at end of file
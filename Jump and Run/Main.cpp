@@ -1,31 +1,83 @@
 
+#include <cmath>
+#include <exception>
 #include <own/modelloader.hpp>
 #include "Map.hpp"
-#include "Player.hpp"
+#include "ECS.hpp"
+#include "Components.hpp"
 #include "Physics.hpp"
+#include "Enemies.hpp"
+#include "Particles.hpp"
+#include "Benchmark.hpp"
+#include "Replay.hpp"
+
+// Seconds between updates of the stats in the window title
+const float STATS_INTERVAL = 0.5f;
+// Landings faster than this (units per second) kick up dust
+const float DUST_SPEED = 8.0f;
+// F3 toggles the step stats in the window title
+bool showStats = false;
+// E grabs the rope in reach or lets go | Held from the last frame, so holding the key only counts once
+bool grabHeld = false;
 
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
 	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS) {
 		glfwSetWindowShouldClose(window, true);
 	}
+	if (key == GLFW_KEY_F3 && action == GLFW_PRESS) {
+		showStats = !showStats;
+		if (!showStats)
+			glfwSetWindowTitle(window, "Jump and Run");
+	}
 }
 
 void framebuffer_callback(GLFWwindow *window, int width, int height) {
 	glViewport(0, 0, width, height);
 }
 
-void processInput(GLFWwindow* window, physics::movementX &movX) {
+// grab is set on a press and left for the next tick to clear
+void processInput(GLFWwindow* window, physics::movementX &movX, bool &grab) {
 	movX = static_cast<physics::movementX>(0);
 
 	if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
 		movX = static_cast<physics::movementX>(movX - 1);
 	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
 		movX = static_cast<physics::movementX>(movX + 1);
+
+	bool grabDown = glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS;
+	if (grabDown && !grabHeld)
+		grab = true;
+	grabHeld = grabDown;
 }
 
 int main(int argc, char* argv[]) {
 
 	console::printInfo("Running from " + std::string(argv[0]));
+
+	float tickRate = physics::DEFAULT_TICK_RATE;
+	std::string recordPath;
+	for (int i = 1; i < argc - 1; ++i) {
+		if (std::string(argv[i]) == "--tickrate") {
+			std::string value = argv[++i];
+			// Anything but a positive finite number leaves the clock ticking forever or never
+			try {
+				tickRate = std::stof(value);
+			}
+			catch (const std::exception&) {
+				tickRate = 0;
+			}
+			if (!(tickRate > 0) || !std::isfinite(tickRate))
+				console::printError("Main: Tick rate has to be a positive number [" + value + "]", true);
+		}
+		else if (std::string(argv[i]) == "--record")
+			recordPath = argv[++i];
+		else if (std::string(argv[i]) == "--bench")
+			return benchmark::run(argv[i + 1]);
+		else if (std::string(argv[i]) == "--replay")
+			return replay::verify(argv[i + 1]);
+	}
+	console::printInfo("Simulating at " + std::to_string(tickRate) + " ticks per second");
+
 	GLFWwindow* window;
 	renderUtil::init::initGLFW(3);
 	renderUtil::init::createWindow(window, 800, 600, "Jump and Run");
@@ -49,39 +101,102 @@ int main(int argc, char* argv[]) {
 
 	gameMap::Block::model = models.addFromFile("block.obj");
 	gameMap::Block::texture = textures.addFromFile("block.png");
-	gamePlayer::Player player(glm::vec2(3, 6));
+	glm::vec2 spawn(3, 6);
 
 	int playerModel = models.addFromFile("player.obj");
 	int playerTexture =textures.addFromFile("player.png");
 
-	gameMap::Block solidBlock;
-
 	gameMap::Map map(&models, &textures, &shader);
-	physics::PhysicsHandler physics(&player,&map);
-
-	for (int i = 0; i < 16; ++i) {
-		map.addBlock(glm::uvec2(i, 2), &solidBlock);
+	gameMap::BlockHandle solidBlock = map.addBlockType();
+	ecs::Registry registry;
+	physics::PhysicsHandler physics(&registry, &map, spawn);
+	enemies::WalkerSystem walkerAI(&registry, &physics);
+	gameEntity::Runner playerRunner;
+	registry.add(physics.getPlayer(), gameEntity::Sprite{ playerModel, playerTexture, -playerRunner.halfExtents });
+
+	gameMap::buildDemoLevel(map, solidBlock);
+	physics::hangDemoRopes(physics.getRopes());
+	physics::RopeRenderer ropeRenderer;
+
+	particles::ParticleSystem effects(&map);
+	particles::Material dust;
+	dust.color = glm::vec4(0.8f, 0.75f, 0.7f, 0.8f);
+	dust.gravityScale = -0.05f;
+	dust.drag = 3.0f;
+	dust.startSize = 0.15f;
+	dust.endSize = 0.5f;
+	particles::MaterialId dustMaterial = effects.addMaterial(dust, 4096);
+	particles::ParticleRenderer particleRenderer;
+	gameEntity::PhysicsBody playerBody = *registry.get<gameEntity::PhysicsBody>(physics.getPlayer());
+
+	std::unique_ptr<replay::Recorder> recorder;
+	if (!recordPath.empty()) {
+		recorder.reset(new replay::Recorder(recordPath, tickRate, spawn));
+		// A time budget would make the recorded ticks depend on this machine
+		walkerAI.getBrains().budgetMs = 0;
 	}
 
-	map.addBlock(glm::uvec2(0, 0), &solidBlock);
-
 	glClearColor(0.0, 0.0, 0.0, 1.0);
 	physics::movementX movX;
+	bool grab = false;
+	physics::TickClock clock(tickRate);
+	util::chrono::point lastFrame = util::chrono::now();
+	physics::StatsAverage stats;
+	float statsTimer = 0;
+	float frameTime = 0;
+
+	// Systems of a frame | Rendering stays on this thread, outside the graph
+	jobs::WorkerPool pool;
+	physics.setWorkerPool(&pool);
+	jobs::FrameGraph frame;
+	frame.add("physics", { "input" }, { "world", "entities", "stats", "particles" }, [&] {
+		while (clock.tick()) {
+			if (grab)
+				physics.toggleRope();
+			physics.updatePhysics(movX, clock.tickTime);
+			// Walkers think once per tick, on the tick just run, so their decisions don't follow the frame rate
+			walkerAI.update(clock.tickTime);
+			stats.add(physics.getWorld().stats);
+			if (recorder)
+				recorder->record(movX, grab, physics.getWorld().stateHash());
+			grab = false;
+			for (const physics::LandingEvent& e : physics.getEvents().read<physics::LandingEvent>()) {
+				if (e.body == playerBody.handle && e.speed > DUST_SPEED)
+					effects.burst(dustMaterial, physics.getPlayerPos() - glm::vec2(0.0f, playerRunner.halfExtents.y), glm::vec2(0.0f, 1.0f), glm::vec2(3.0f, 1.0f), 0.6f, 24);
+			}
+		}
+	});
+	frame.add("particles", { "world" }, { "particles" }, [&] {
+		effects.update(frameTime);
+		effects.buildInstances();
+	});
 
 	while (!glfwWindowShouldClose(window)) {
-		glClear(GL_COLOR_BUFFER_BIT);
+		util::chrono::point currentFrame = util::chrono::now();
+		clock.advance(util::chrono::deltaTime(lastFrame, currentFrame));
+		frameTime = util::chrono::deltaTime(lastFrame, currentFrame);
+		statsTimer += frameTime;
+		lastFrame = currentFrame;
+
+		processInput(window, movX, grab);
+		frame.run(pool);
+
+		if (showStats && statsTimer >= STATS_INTERVAL) {
+			std::string title = "Jump and Run | " + physics::describe(stats.average()) + " | workers";
+			for (const jobs::WorkerStats& worker : pool.takeStats())
+				title += " " + std::to_string(static_cast<int>(worker.busyMs / (statsTimer * 10))) + "%";
+			statsTimer = 0;
+			glfwSetWindowTitle(window, title.c_str());
+		}
 
-		processInput(window, movX);
-		physics.updatePhysics(movX);
+		glClear(GL_COLOR_BUFFER_BIT);
 
 		shader.use();
 		map.renderMap();
 
-		textures.use(playerTexture);
-		glm::mat4 model;
-		model = glm::translate(model, glm::vec3(player.pos.x - player.width, player.pos.y - player.height, -2));
-		shader.setMat4("model", model);
-		models.draw(playerModel);
+		gameEntity::drawSprites(registry, models, textures, shader, clock.alpha());
+		ropeRenderer.draw(physics.getRopes(), projection, view, clock.alpha());
+		particleRenderer.draw(effects, projection, view);
 
 		glfwSwapBuffers(window);
 		glfwPollEvents();
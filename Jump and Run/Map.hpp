@@ -1,59 +1,344 @@
 #pragma once
 #include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
 #include <glm/glm.hpp>
 #include <own/modelloader.hpp>
+#include "Fixed.hpp"
+#include "SlabPool.hpp"
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 namespace gameMap {
+	// Index of the lowest set bit | v must not be 0
+	inline int lowestBit(uint64_t v) {
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward64(&index, v);
+		return static_cast<int>(index);
+#else
+		return __builtin_ctzll(v);
+#endif
+	}
+
+	enum shapeKind {SHAPE_EMPTY = 0, SHAPE_FULL, SHAPE_HALF, SHAPE_SLOPE, SHAPE_ONE_WAY};
+
+	// Collision shape a block declares | left and right are the surface heights at the cell edges, as fractions of a cell
+	struct TileShape {
+		shapeKind kind;
+		float left, right;
+
+		TileShape(shapeKind kind = SHAPE_FULL, float left = 1.0f, float right = 1.0f)
+			: kind(kind), left(left), right(right) {}
+
+		static TileShape half() {
+			return TileShape(SHAPE_HALF, 0.5f, 0.5f);
+		}
+
+		// Straight surface from left to right | Slopes up to 45 degrees can be walked up
+		static TileShape slope(float left, float right) {
+			return TileShape(SHAPE_SLOPE, left, right);
+		}
+
+		// Thin platform at the top of the cell, only solid when landed on from above
+		static TileShape oneWay() {
+			return TileShape(SHAPE_ONE_WAY);
+		}
+
+		bool operator==(const TileShape& o) const {
+			return kind == o.kind && left == o.left && right == o.right;
+		}
+	};
+
+	// Lookup table entry the collision sweeps read | Every shape is a column filled from the cell bottom up to a linear surface
+	struct CollisionShape {
+		physics::real left, right;
+		// Side and bottom faces block | False for empty cells and one-way platforms
+		bool walls;
+		// Surface blocks boxes coming from above
+		bool top;
+	};
+
+	// Entries of a map's shape table, ids are one byte per cell
+	const size_t MAX_TILE_SHAPES = 256;
+
 	class Block {
 	private:
 
 	public:
 		static int model, texture;
 
-		bool isCollision(glm::vec2 pos) {
-			return true;
-		}
+		TileShape shape;
+
+		Block(TileShape shape = TileShape())
+			: shape(shape) {}
 	};
 
 	int Block::model = 0, Block::texture = 0;
 
+	// Block type registered with a Map | Cells whose type was removed read as empty
+	typedef memory::Handle BlockHandle;
+	const BlockHandle NO_BLOCK = memory::NO_HANDLE;
+
+	// One addBlock or replaceBlock | Enough to take it back
+	struct CellChange {
+		glm::uvec2 pos;
+		// NO_BLOCK if the cell was empty
+		BlockHandle before;
+		BlockHandle after;
+	};
+
 	class Map {
 	private:
-		std::unordered_map<glm::uvec2, Block*> mapGrid;
+		std::unordered_map<glm::uvec2, BlockHandle> mapGrid;
+		// Block types the cells refer to
+		memory::SlabPool<Block> blocks;
 		modelLoader::ModelContainer* modelContainer;
 		renderUtil::TextureEngine* textureContainer;
 		renderUtil::ShaderEngine* shader;
+
+		// Dense collision bitset | One bit per cell, rows padded to whole 64 bit words
+		std::vector<uint64_t> collisionBits;
+		unsigned int gridWidth = 0, gridHeight = 0, rowWords = 0;
+
+		// Compiled shapes | Entry 0 is the empty cell, each distinct TileShape gets one entry the first time a block uses it
+		std::vector<TileShape> shapeSources;
+		std::vector<CollisionShape> shapeTable;
+		// Index into shapeTable per cell, gridWidth entries per row
+		std::vector<uint8_t> shapeIds;
+
+		// Cells changed since the last clearEdits | Lets the physics wake bodies near them
+		std::vector<glm::uvec2> edits;
+
+		// Cells changed since the last takeChanges | Only kept while logging, maps without rollback don't grow a log
+		std::vector<CellChange> changes;
+		bool loggingChanges = false;
+
+		uint8_t compileShape(const TileShape& shape) {
+			for (size_t i = 0; i < shapeSources.size(); ++i) {
+				if (shapeSources[i] == shape)
+					return static_cast<uint8_t>(i);
+			}
+			// Cells store the id in a byte | Wrapping around would silently turn the cell into entry 0, the empty one
+			if (shapeTable.size() == MAX_TILE_SHAPES)
+				console::printError("Map: Too many distinct tile shapes | At most " + std::to_string(MAX_TILE_SHAPES) + " including the empty one", true);
+			CollisionShape compiled;
+			compiled.left = physics::toReal(shape.left);
+			compiled.right = physics::toReal(shape.right);
+			compiled.walls = shape.kind != SHAPE_EMPTY && shape.kind != SHAPE_ONE_WAY;
+			compiled.top = shape.kind != SHAPE_EMPTY;
+			shapeSources.push_back(shape);
+			shapeTable.push_back(compiled);
+			return static_cast<uint8_t>(shapeTable.size() - 1);
+		}
+
+		// Grows the bitset so pos lies inside, keeping existing bits
+		// At least doubles a side that grows, so filling a level row by row copies the grid a logarithmic number of times
+		void growGrid(glm::uvec2 pos) {
+			if (pos.x < gridWidth && pos.y < gridHeight)
+				return;
+			unsigned int newWidth = pos.x < gridWidth ? gridWidth : std::max(pos.x + 1, 2 * gridWidth);
+			unsigned int newHeight = pos.y < gridHeight ? gridHeight : std::max(pos.y + 1, 2 * gridHeight);
+			unsigned int newRowWords = (newWidth + 63) / 64;
+
+			std::vector<uint64_t> newBits(newRowWords * newHeight, 0);
+			std::vector<uint8_t> newIds(newWidth * newHeight, 0);
+			for (unsigned int y = 0; y < gridHeight; ++y) {
+				for (unsigned int w = 0; w < rowWords; ++w) {
+					newBits[y * newRowWords + w] = collisionBits[y * rowWords + w];
+				}
+				std::copy(shapeIds.begin() + y * gridWidth, shapeIds.begin() + (y + 1) * gridWidth, newIds.begin() + y * newWidth);
+			}
+			collisionBits.swap(newBits);
+			shapeIds.swap(newIds);
+			gridWidth = newWidth;
+			gridHeight = newHeight;
+			rowWords = newRowWords;
+		}
+
+		void updateCollisionBit(glm::uvec2 pos, BlockHandle handle) {
+			growGrid(pos);
+			const Block* block = blocks.get(handle);
+			uint64_t bit = uint64_t(1) << (pos.x % 64);
+			uint64_t& word = collisionBits[pos.y * rowWords + pos.x / 64];
+			uint8_t id = block ? compileShape(block->shape) : 0;
+			if (id != 0 && shapeTable[id].top)
+				word |= bit;
+			else
+				word &= ~bit;
+			shapeIds[pos.y * gridWidth + pos.x] = id;
+			edits.push_back(pos);
+		}
+
+		// Writes a cell without logging it | NO_BLOCK empties it
+		void setCell(glm::uvec2 pos, BlockHandle block) {
+			if (block != NO_BLOCK)
+				mapGrid[pos] = block;
+			else
+				mapGrid.erase(pos);
+			updateCollisionBit(pos, block);
+		}
 	public:
 		Map(modelLoader::ModelContainer* container, renderUtil::TextureEngine* textureContainer, renderUtil::ShaderEngine* shader)
-			: modelContainer(container), textureContainer(textureContainer), shader(shader) {}
+			: modelContainer(container), textureContainer(textureContainer), shader(shader) {
+			compileShape(TileShape(SHAPE_EMPTY, 0.0f, 0.0f));
+		}
+
+		// Registers a block type cells can be filled with
+		BlockHandle addBlockType(const Block& block = Block()) {
+			return blocks.create(block);
+		}
+
+		// nullptr once the type was removed
+		const Block* getBlockType(BlockHandle block) const {
+			return blocks.get(block);
+		}
+
+		// Empties every cell of the type, logged like any other change | Handles to it stop resolving
+		void removeBlockType(BlockHandle block) {
+			if (!blocks.valid(block))
+				return;
+			std::vector<glm::uvec2> cells;
+			for (auto& i : mapGrid) {
+				if (i.second == block)
+					cells.push_back(i.first);
+			}
+			blocks.destroy(block);
+			for (glm::uvec2 pos : cells) {
+				if (loggingChanges)
+					changes.push_back({ pos, block, NO_BLOCK });
+				setCell(pos, NO_BLOCK);
+			}
+		}
 
-		bool addBlock(glm::uvec2 pos, Block* block) {
+		bool addBlock(glm::uvec2 pos, BlockHandle block) {
 			if (mapGrid.find(pos) != mapGrid.end())
 				return false;
 			mapGrid.emplace(pos, block);
+			updateCollisionBit(pos, block);
+			if (loggingChanges)
+				changes.push_back({ pos, NO_BLOCK, block });
 			return true;
 		}
 
-		bool replaceBlock(glm::uvec2 pos, Block* block) {
+		bool replaceBlock(glm::uvec2 pos, BlockHandle block) {
 			if (mapGrid.find(pos) == mapGrid.end())
 				return false;
+			if (loggingChanges)
+				changes.push_back({ pos, mapGrid.at(pos), block });
 			mapGrid.at(pos) = block;
+			updateCollisionBit(pos, block);
+			return true;
 		}
 
 		bool getCollision(glm::uvec2 pos) {
-			if (mapGrid.find(pos) == mapGrid.end())
+			auto found = mapGrid.find(pos);
+			if (found == mapGrid.end())
+				return false;
+			const Block* block = blocks.get(found->second);
+			return block && block->shape.kind != SHAPE_EMPTY;
+		}
+
+		const std::vector<glm::uvec2>& getEdits() const {
+			return edits;
+		}
+
+		void clearEdits() {
+			edits.clear();
+		}
+
+		// Puts back edits saved with getEdits
+		void setEdits(const std::vector<glm::uvec2>& saved) {
+			edits.assign(saved.begin(), saved.end());
+		}
+
+		void logChanges(bool enable) {
+			loggingChanges = enable;
+			changes.clear();
+		}
+
+		// Moves the changes logged since the last call into to | Reuses to's memory
+		void takeChanges(std::vector<CellChange>& to) {
+			to.assign(changes.begin(), changes.end());
+			changes.clear();
+		}
+
+		// Takes back a list of changes, newest first, without logging it
+		void undoChanges(const std::vector<CellChange>& list) {
+			for (auto it = list.rbegin(); it != list.rend(); ++it)
+				setCell(it->pos, it->before);
+		}
+
+		// Takes back the changes not taken yet
+		void undoPendingChanges() {
+			undoChanges(changes);
+			changes.clear();
+		}
+
+		// Cells the grid covers, at least every cell ever filled | Everything outside of it is empty
+		glm::uvec2 gridSize() const {
+			return glm::uvec2(gridWidth, gridHeight);
+		}
+
+		// Bitset lookup of a single cell | Cells outside the map are never solid
+		bool isSolid(int x, int y) const {
+			if (x < 0 || y < 0 || unsigned(x) >= gridWidth || unsigned(y) >= gridHeight)
 				return false;
-			return mapGrid.at(pos)->isCollision(pos);
+			return (collisionBits[y * rowWords + x / 64] >> (x % 64)) & 1;
+		}
+
+		// Calls func(x, y) for every solid cell in [x0, x1] x [y0, y1] until it returns true
+		// Reads the bitset a word at a time, so empty stretches cost one load per 64 cells | Returns whether func stopped early
+		template<typename F>
+		bool forSolidCells(int x0, int y0, int x1, int y1, F func) const {
+			x0 = std::max(x0, 0);
+			y0 = std::max(y0, 0);
+			x1 = std::min(x1, static_cast<int>(gridWidth) - 1);
+			y1 = std::min(y1, static_cast<int>(gridHeight) - 1);
+			for (int y = y0; y <= y1; ++y) {
+				for (int w = x0 / 64; w <= x1 / 64 && x0 <= x1; ++w) {
+					uint64_t bits = collisionBits[y * rowWords + w];
+					if (w == x0 / 64)
+						bits &= ~uint64_t(0) << (x0 % 64);
+					if (w == x1 / 64 && x1 % 64 != 63)
+						bits &= (uint64_t(1) << (x1 % 64 + 1)) - 1;
+					while (bits) {
+						if (func(w * 64 + lowestBit(bits), y))
+							return true;
+						bits &= bits - 1;
+					}
+				}
+			}
+			return false;
+		}
+
+		// Compiled shape of a cell | Cells outside the map are empty
+		const CollisionShape& shapeAt(int x, int y) const {
+			if (x < 0 || y < 0 || unsigned(x) >= gridWidth || unsigned(y) >= gridHeight)
+				return shapeTable[0];
+			return shapeTable[shapeIds[y * gridWidth + x]];
 		}
 
 		void renderMap() {
 			for (auto &i : mapGrid) {
-				textureContainer->use(i.second->texture);
+				const Block* block = blocks.get(i.second);
+				if (!block)
+					continue;
+				textureContainer->use(block->texture);
 				glm::mat4 model;
 				model = glm::translate(model, glm::vec3(i.first.x, i.first.y, -2));
 				shader->setMat4("model", model);
-				modelContainer->draw(i.second->model);
+				modelContainer->draw(block->model);
 			}
 		}
 	};
+
+	// Floor along the bottom of the screen plus a single block in the corner | Shared by the game and replay checks
+	inline void buildDemoLevel(Map& map, BlockHandle solid) {
+		for (unsigned int i = 0; i < 16; ++i)
+			map.addBlock(glm::uvec2(i, 2), solid);
+		map.addBlock(glm::uvec2(0, 0), solid);
+	}
 }
\ No newline at end of file
@@ -0,0 +1,402 @@
+#pragma once
+#include <vector>
+#include <random>
+#include <cstdint>
+#include <algorithm>
+#include <emmintrin.h>
+#include <glm/glm.hpp>
+#include <own/renderutil.hpp>
+#include "Map.hpp"
+#include "World.hpp"
+
+
+// Dust, sparks and debris | Purely visual, they run on frame time and never touch the simulation
+namespace particles {
+
+	// Floats per SSE register | The arrays are padded to it so kernels always load whole registers
+	const uint32_t PARTICLE_LANES = 4;
+	// Particles per material unless addMaterial is told otherwise
+	const size_t DEFAULT_PARTICLE_CAPACITY = 1 << 16;
+	// Share of its speed a particle keeps bouncing off a tile, and of its sideways speed when it hits the ground
+	const float PARTICLE_BOUNCE = 0.3f;
+	const float PARTICLE_FRICTION = 0.6f;
+
+	typedef uint16_t MaterialId;
+
+	// How particles of one kind move and look | Every material with live particles is one instanced draw
+	struct Material {
+		glm::vec4 color = glm::vec4(1.0f);
+		// Edge length at birth and at the end of the lifetime, interpolated in between
+		float startSize = 0.2f, endSize = 0.05f;
+		// Multiplies the system's gravity | Negative ones rise
+		float gravityScale = 1.0f;
+		// Share of the velocity lost per second
+		float drag = 0.0f;
+		// Bounces off solid tiles | Costs a cell lookup per particle and frame
+		bool collides = false;
+	};
+
+	// Spawns particles at a steady rate while rate is above 0
+	struct Emitter {
+		MaterialId material;
+		glm::vec2 pos;
+		glm::vec2 velocity;
+		// Random extra velocity in [-spread, spread] per axis
+		glm::vec2 spread;
+		// Particles per second and seconds each of them lives
+		float rate, lifetime;
+		// Part of a particle left over from the last updates
+		float owed = 0;
+	};
+
+	// One quad as the GPU gets it | Color comes from the material
+	struct ParticleInstance {
+		float x, y, size, alpha;
+	};
+
+	// Particles in flat arrays, one set per material with the alive ones packed at the front
+	// Kernels run over them four at a time | Materials never mix, so every material's instances come out as one range
+	class ParticleSystem {
+	private:
+		struct Pool {
+			Material kind;
+			size_t capacity;
+			uint32_t count = 0;
+			// Index i belongs to particle i | Padded by PARTICLE_LANES, kernels write the padding but nobody reads it
+			std::vector<float> posX, posY, velX, velY;
+			std::vector<float> age, invLife;
+			// Written by advance for the instances
+			std::vector<float> edge, alpha;
+			uint32_t firstInstance = 0;
+
+			uint32_t padded() const {
+				return (count + PARTICLE_LANES - 1) / PARTICLE_LANES * PARTICLE_LANES;
+			}
+		};
+
+		const gameMap::Map* map;
+		std::vector<Pool> pools;
+		std::vector<Emitter> emitters;
+		std::minstd_rand random;
+		std::uniform_real_distribution<float> unit;
+
+		// Scratch of the kernels | Sized to the largest pool
+		std::vector<int32_t> cellX, cellY;
+		std::vector<uint32_t> inGrid, dead;
+		std::vector<ParticleInstance> instances;
+		uint32_t instanceTotal = 0;
+
+		float randomIn(float spread) {
+			return (unit(random) * 2.0f - 1.0f) * spread;
+		}
+
+		void spawnEmitted(float dt) {
+			for (Emitter& e : emitters) {
+				if (e.rate <= 0)
+					continue;
+				e.owed += e.rate * dt;
+				for (; e.owed >= 1.0f; e.owed -= 1.0f)
+					spawn(e.material, e.pos, e.velocity + glm::vec2(randomIn(e.spread.x), randomIn(e.spread.y)), e.lifetime);
+			}
+		}
+
+		static uint32_t lowestLane(int mask) {
+			uint32_t lane = 0;
+			while (!(mask & (1 << lane)))
+				++lane;
+			return lane;
+		}
+
+		// Rounds down without a libm call | Truncation went up for negative fractions
+		static int floorCell(float v) {
+			int cell = static_cast<int>(v);
+			return cell - (v < static_cast<float>(cell));
+		}
+
+		// floorCell four at a time
+		static __m128i floorCells(__m128 v) {
+			__m128i cell = _mm_cvttps_epi32(v);
+			return _mm_add_epi32(cell, _mm_castps_si128(_mm_cmpgt_ps(_mm_cvtepi32_ps(cell), v)));
+		}
+
+		// Gravity, drag, motion, size and alpha over the lifetime in one pass over the arrays
+		// Collects the particles whose lifetime is over and, for colliding materials, the ones over the tile grid
+		void advance(Pool& pool, float dt) {
+			float* px = pool.posX.data();
+			float* py = pool.posY.data();
+			float* vx = pool.velX.data();
+			float* vy = pool.velY.data();
+			float* a = pool.age.data();
+			const float* inv = pool.invLife.data();
+			float* e = pool.edge.data();
+			float* f = pool.alpha.data();
+			const bool collides = pool.kind.collides;
+			glm::uvec2 grid = map->gridSize();
+
+			const __m128 step = _mm_set1_ps(dt), one = _mm_set1_ps(1.0f);
+			const __m128 keep = _mm_set1_ps(std::max(1.0f - pool.kind.drag * dt, 0.0f));
+			const __m128 fall = _mm_set1_ps(gravity.y * pool.kind.gravityScale * dt);
+			const __m128 startSize = _mm_set1_ps(pool.kind.startSize), grow = _mm_set1_ps(pool.kind.endSize - pool.kind.startSize);
+			const __m128i width = _mm_set1_epi32(static_cast<int>(grid.x)), height = _mm_set1_epi32(static_cast<int>(grid.y)), negative = _mm_set1_epi32(-1);
+
+			dead.clear();
+			inGrid.clear();
+			for (uint32_t i = 0; i < pool.padded(); i += PARTICLE_LANES) {
+				__m128 velocityX = _mm_mul_ps(_mm_loadu_ps(vx + i), keep);
+				__m128 velocityY = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(vy + i), fall), keep);
+				__m128 x = _mm_add_ps(_mm_loadu_ps(px + i), _mm_mul_ps(velocityX, step));
+				__m128 y = _mm_add_ps(_mm_loadu_ps(py + i), _mm_mul_ps(velocityY, step));
+				__m128 age = _mm_add_ps(_mm_loadu_ps(a + i), step);
+				_mm_storeu_ps(vx + i, velocityX);
+				_mm_storeu_ps(vy + i, velocityY);
+				_mm_storeu_ps(px + i, x);
+				_mm_storeu_ps(py + i, y);
+				_mm_storeu_ps(a + i, age);
+
+				__m128 t = _mm_mul_ps(age, _mm_loadu_ps(inv + i));
+				int over = _mm_movemask_ps(_mm_cmpge_ps(t, one));
+				t = _mm_min_ps(t, one);
+				_mm_storeu_ps(e + i, _mm_add_ps(startSize, _mm_mul_ps(grow, t)));
+				_mm_storeu_ps(f + i, _mm_sub_ps(one, t));
+
+				int lanes = 0;
+				if (collides) {
+					__m128i cx = floorCells(x), cy = floorCells(y);
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(cellX.data() + i), cx);
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(cellY.data() + i), cy);
+					__m128i inside = _mm_and_si128(_mm_and_si128(_mm_cmpgt_epi32(cx, negative), _mm_cmplt_epi32(cx, width)),
+						_mm_and_si128(_mm_cmpgt_epi32(cy, negative), _mm_cmplt_epi32(cy, height)));
+					lanes = _mm_movemask_ps(_mm_castsi128_ps(inside));
+				}
+				// Padding lanes past count don't belong to anyone
+				if (pool.count - i < PARTICLE_LANES) {
+					over &= (1 << (pool.count - i)) - 1;
+					lanes &= (1 << (pool.count - i)) - 1;
+				}
+				for (; over; over &= over - 1)
+					dead.push_back(i + lowestLane(over));
+				for (; lanes; lanes &= lanes - 1)
+					inGrid.push_back(i + lowestLane(lanes));
+			}
+		}
+
+		// Particles over the grid that moved into a solid cell go back along the axes that took them there and bounce
+		void collide(Pool& pool, float dt) {
+			for (uint32_t i : inGrid) {
+				if (!map->isSolid(cellX[i], cellY[i]))
+					continue;
+				float fromX = pool.posX[i] - pool.velX[i] * dt, fromY = pool.posY[i] - pool.velY[i] * dt;
+				if (map->isSolid(cellX[i], floorCell(fromY))) {
+					pool.posX[i] = fromX;
+					pool.velX[i] *= -PARTICLE_BOUNCE;
+				}
+				if (map->isSolid(floorCell(pool.posX[i]), cellY[i])) {
+					pool.posY[i] = fromY;
+					pool.velY[i] *= -PARTICLE_BOUNCE;
+					pool.velX[i] *= PARTICLE_FRICTION;
+				}
+			}
+		}
+
+		// Fills the gaps of dead particles from the back | Highest first, so a moved particle is never a dead one
+		void removeDead(Pool& pool) {
+			for (size_t k = dead.size(); k-- > 0;) {
+				uint32_t i = dead[k];
+				uint32_t last = --pool.count;
+				if (i == last)
+					continue;
+				for (std::vector<float>* a : { &pool.posX, &pool.posY, &pool.velX, &pool.velY, &pool.age, &pool.invLife, &pool.edge, &pool.alpha })
+					(*a)[i] = (*a)[last];
+			}
+		}
+
+		// Four particles become four instances with one transpose | Writes up to three instances of padding past the pool
+		void writeInstances(const Pool& pool) {
+			float* out = reinterpret_cast<float*>(instances.data() + pool.firstInstance);
+			for (uint32_t i = 0; i < pool.padded(); i += PARTICLE_LANES) {
+				__m128 x = _mm_loadu_ps(pool.posX.data() + i), y = _mm_loadu_ps(pool.posY.data() + i);
+				__m128 e = _mm_loadu_ps(pool.edge.data() + i), f = _mm_loadu_ps(pool.alpha.data() + i);
+				_MM_TRANSPOSE4_PS(x, y, e, f);
+				_mm_storeu_ps(out + i * 4, x);
+				_mm_storeu_ps(out + i * 4 + 4, y);
+				_mm_storeu_ps(out + i * 4 + 8, e);
+				_mm_storeu_ps(out + i * 4 + 12, f);
+			}
+		}
+	public:
+		glm::vec2 gravity = physics::DEFAULT_GRAVITY;
+		// Particles that didn't fit into their material's pool since the system was created
+		size_t dropped = 0;
+
+		ParticleSystem(const gameMap::Map* map, unsigned int seed = 1)
+			: map(map), random(seed), unit(0.0f, 1.0f) {}
+
+		// capacity is the most particles of the material alive at once | Allocates all of them up front
+		MaterialId addMaterial(const Material& kind, size_t capacity = DEFAULT_PARTICLE_CAPACITY) {
+			pools.emplace_back();
+			Pool& pool = pools.back();
+			pool.kind = kind;
+			pool.capacity = capacity;
+			for (std::vector<float>* a : { &pool.posX, &pool.posY, &pool.velX, &pool.velY, &pool.age, &pool.invLife, &pool.edge, &pool.alpha })
+				a->resize(capacity + PARTICLE_LANES, 0.0f);
+			size_t largest = std::max(cellX.size(), capacity + PARTICLE_LANES);
+			cellX.resize(largest);
+			cellY.resize(largest);
+			inGrid.reserve(largest);
+			dead.reserve(largest);
+			instances.resize(instances.size() + capacity + PARTICLE_LANES);
+			return static_cast<MaterialId>(pools.size() - 1);
+		}
+
+		size_t materialCount() const {
+			return pools.size();
+		}
+
+		const Material& getMaterial(MaterialId m) const {
+			return pools[m].kind;
+		}
+
+		// Index of the emitter | Stays valid, set its rate to 0 to stop it
+		size_t addEmitter(const Emitter& emitter) {
+			emitters.push_back(emitter);
+			return emitters.size() - 1;
+		}
+
+		Emitter& getEmitter(size_t emitter) {
+			return emitters[emitter];
+		}
+
+		void spawn(MaterialId m, glm::vec2 pos, glm::vec2 velocity, float lifetime) {
+			Pool& pool = pools[m];
+			if (pool.count == pool.capacity) {
+				++dropped;
+				return;
+			}
+			uint32_t i = pool.count++;
+			pool.posX[i] = pos.x;
+			pool.posY[i] = pos.y;
+			pool.velX[i] = velocity.x;
+			pool.velY[i] = velocity.y;
+			pool.age[i] = 0.0f;
+			pool.invLife[i] = 1.0f / lifetime;
+			pool.edge[i] = pool.kind.startSize;
+			pool.alpha[i] = 1.0f;
+		}
+
+		// amount particles at pos going velocity plus up to spread per axis | Lifetimes vary by a quarter around lifetime
+		void burst(MaterialId m, glm::vec2 pos, glm::vec2 velocity, glm::vec2 spread, float lifetime, size_t amount) {
+			for (size_t k = 0; k < amount; ++k)
+				spawn(m, pos, velocity + glm::vec2(randomIn(spread.x), randomIn(spread.y)), lifetime * (1.0f + randomIn(0.25f)));
+		}
+
+		// Emits, moves and ages every particle by dt and removes the ones that are gone
+		void update(float dt) {
+			spawnEmitted(dt);
+			for (Pool& pool : pools) {
+				advance(pool, dt);
+				collide(pool, dt);
+				removeDead(pool);
+			}
+		}
+
+		// Lays the instances out material after material | No allocation, the buffer holds every pool's capacity
+		void buildInstances() {
+			instanceTotal = 0;
+			for (Pool& pool : pools) {
+				pool.firstInstance = instanceTotal;
+				writeInstances(pool);
+				instanceTotal += pool.count;
+			}
+		}
+
+		size_t size() const {
+			size_t total = 0;
+			for (const Pool& pool : pools)
+				total += pool.count;
+			return total;
+		}
+
+		// Instances of the last buildInstances, instanceTotal of them
+		const ParticleInstance* getInstances() const {
+			return instances.data();
+		}
+
+		uint32_t instanceCount() const {
+			return instanceTotal;
+		}
+
+		uint32_t firstInstance(MaterialId m) const {
+			return pools[m].firstInstance;
+		}
+
+		// Instances of material m as of the last buildInstances
+		uint32_t instanceCount(MaterialId m) const {
+			return size_t(m) + 1 < pools.size() ? pools[m + 1].firstInstance - pools[m].firstInstance : instanceTotal - pools[m].firstInstance;
+		}
+	};
+
+	// Draws a ParticleSystem with one instanced quad draw per material | The instance buffer is refilled every frame
+	class ParticleRenderer {
+	private:
+		renderUtil::ShaderEngine shader;
+		GLuint vao = 0, quad = 0, instanceBuffer = 0;
+		size_t bufferSize = 0;
+	public:
+		ParticleRenderer(const std::string& vertexPath = "particle.vert", const std::string& fragmentPath = "particle.frag")
+			: shader(vertexPath, fragmentPath) {
+			const float corners[] = { -0.5f, -0.5f, 0.5f, -0.5f, -0.5f, 0.5f, 0.5f, 0.5f };
+			glGenVertexArrays(1, &vao);
+			glBindVertexArray(vao);
+
+				glGenBuffers(1, &quad);
+				glBindBuffer(GL_ARRAY_BUFFER, quad);
+				glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+				glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+				glEnableVertexAttribArray(0);
+
+				glGenBuffers(1, &instanceBuffer);
+				glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+				glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(ParticleInstance), (void*)0);
+				glVertexAttribDivisor(1, 1);
+				glEnableVertexAttribArray(1);
+
+			glBindVertexArray(0);
+		}
+
+		~ParticleRenderer() {
+			glDeleteBuffers(1, &instanceBuffer);
+			glDeleteBuffers(1, &quad);
+			glDeleteVertexArrays(1, &vao);
+		}
+
+		// Uploads the instances of the last buildInstances and draws them over everything drawn so far
+		void draw(const ParticleSystem& system, const glm::mat4& projection, const glm::mat4& view) {
+			if (system.instanceCount() == 0)
+				return;
+
+			glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+			size_t bytes = system.instanceCount() * sizeof(ParticleInstance);
+			// Orphans last frame's storage, so the upload doesn't wait for draws still reading it
+			bufferSize = std::max(bufferSize, bytes);
+			glBufferData(GL_ARRAY_BUFFER, bufferSize, nullptr, GL_STREAM_DRAW);
+			glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, system.getInstances());
+
+			shader.use();
+			shader.setMat4("projection", projection);
+			shader.setMat4("view", view);
+			glEnable(GL_BLEND);
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			glBindVertexArray(vao);
+			for (MaterialId m = 0; m < system.materialCount(); ++m) {
+				if (system.instanceCount(m) == 0)
+					continue;
+				shader.setVec4("color", system.getMaterial(m).color);
+				// GL 3.3 has no base instance, so the instance attribute starts at the material's range instead
+				glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(ParticleInstance), (void*)(system.firstInstance(m) * sizeof(ParticleInstance)));
+				glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, system.instanceCount(m));
+			}
+			glBindVertexArray(0);
+			glDisable(GL_BLEND);
+		}
+	};
+}
\ No newline at end of file
@@ -1,6 +1,13 @@
 #pragma once
+#include <vector>
+#include <string>
+#include <algorithm>
 #include "Map.hpp"
-#include "Player.hpp"
+#include "ECS.hpp"
+#include "Components.hpp"
+#include "World.hpp"
+#include "Rope.hpp"
+#include "Projectile.hpp"
 
 
 namespace physics {
@@ -8,24 +15,274 @@ namespace physics {
 	enum movementX {LEFT = -1, STILLX = 0, RIGHT = 1};
 	enum movementY {UP = 1, STILLY = 0, DOWN = -1};
 
+	// Ticks per second the simulation runs at, independent of the frame rate
+	const float DEFAULT_TICK_RATE = 60.0f;
+	// Upper bound of frame time fed into the accumulator | Prevents a spiral of death after stalls
+	const float MAX_FRAME_TIME = 0.25f;
+	// Kill zone under the level | Falling into it puts entities with a Respawn back to their spawn point
+	const glm::vec2 KILL_ZONE_MIN(-64.0f, -64.0f);
+	const glm::vec2 KILL_ZONE_MAX(80.0f, -16.0f);
+
+	// Area the fixed camera shows | Bodies far outside it run at a lower rate or freeze
+	const glm::vec2 VIEW_MIN(0.0f, 0.0f);
+	const glm::vec2 VIEW_MAX(16.0f, 9.0f);
+
+	enum triggerTag : uint32_t {TAG_KILL_ZONE = 1};
+
+	// Entity that fell into the kill zone and went back to its spawn point
+	struct RespawnEvent {
+		ecs::Entity entity;
+		// Where it fell in
+		glm::vec2 pos;
+	};
+
+	// Walker taken out of the game by despawn
+	struct EnemyDiedEvent {
+		ecs::Entity entity;
+		glm::vec2 pos;
+	};
+
+	// Distance from the player center a rope can be grabbed within
+	const float GRAB_RADIUS = 0.75f;
+	// Sideways acceleration the player can swing with while hanging on a rope
+	const float SWING_ACCELERATION = 8.0f;
+	// Accumulates real time and hands it out in fixed sized ticks
+	class TickClock {
+	private:
+		float accumulator = 0;
+	public:
+		const float tickTime;
+
+		TickClock(float tickRate = DEFAULT_TICK_RATE)
+			: tickTime(1.0f / tickRate) {}
+
+		// Adds passed frame time to the accumulator
+		void advance(float frameTime) {
+			accumulator += frameTime < MAX_FRAME_TIME ? frameTime : MAX_FRAME_TIME;
+		}
+
+		// Consumes one tick from the accumulator | Returns false if less than a tick is left
+		bool tick() {
+			if (accumulator < tickTime)
+				return false;
+			accumulator -= tickTime;
+			return true;
+		}
+
+		// Fraction of a tick left in the accumulator | Used for render interpolation
+		float alpha() {
+			return accumulator / tickTime;
+		}
+	};
+
+	// Runs the World and the systems of every entity with a PhysicsBody | The entities live in the registry
 	class PhysicsHandler {
 	private:
-		gamePlayer::Player* player;
+		ecs::Registry* registry;
 		gameMap::Map* map;
+		World world;
+		RopeSystem ropes;
+		ProjectileSystem projectiles;
+		events::EventBus bus;
+		ecs::Entity player;
+		BodyHandle playerBody;
+		bool hanging = false;
+		// Bodies that entered the kill zone this tick | Scratch
+		std::vector<BodyHandle> fallen;
+
+		// Motion and body for an entity made of a Runner
+		gameEntity::Motion makeMotion(glm::vec2 pos) {
+			return gameEntity::Motion{ pos, pos, glm::vec2(0) };
+		}
+
+		gameEntity::PhysicsBody makeBody(glm::vec2 pos, const gameEntity::Runner& runner) {
+			return gameEntity::PhysicsBody{ world.addBody(pos, runner.halfExtents) };
+		}
+
+		// Walkers keep going the way they last decided every tick and take the jump they asked for once
+		void walk() {
+			registry->each<gameEntity::PhysicsBody, gameEntity::Runner, gameEntity::Walker>([&](ecs::Entity, gameEntity::PhysicsBody& body, gameEntity::Runner& runner, gameEntity::Walker& walker) {
+				glm::vec2 velocity = world.getVelocity(body.handle);
+				world.setVelocity(body.handle, glm::vec2(runner.runSpeed * walker.direction, walker.jump > 0 ? walker.jump : velocity.y));
+				walker.jump = 0;
+			});
+		}
+
+		// Entities that entered the kill zone go back to their spawn point | One pass over the entities however many fell
+		void respawn() {
+			fallen.clear();
+			for (const TriggerEvent& e : world.getTriggerEvents()) {
+				if (e.type == TRIGGER_ENTER && e.tag == TAG_KILL_ZONE)
+					fallen.push_back(e.body);
+			}
+			if (fallen.empty())
+				return;
+			if (std::find(fallen.begin(), fallen.end(), playerBody) != fallen.end())
+				releaseRope();
+			std::sort(fallen.begin(), fallen.end());
+			registry->each<gameEntity::PhysicsBody, gameEntity::Respawn>([&](ecs::Entity entity, gameEntity::PhysicsBody& body, gameEntity::Respawn& respawn) {
+				if (std::binary_search(fallen.begin(), fallen.end(), body.handle)) {
+					bus.publish(RespawnEvent{ entity, world.getPos(body.handle) });
+					world.teleport(body.handle, respawn.spawn);
+				}
+			});
+		}
+
+		// Copies the bodies' state into the Motion components
+		void syncMotion() {
+			registry->each<gameEntity::PhysicsBody, gameEntity::Motion>([&](ecs::Entity, gameEntity::PhysicsBody& body, gameEntity::Motion& motion) {
+				motion.prevPos = world.getPrevPos(body.handle);
+				motion.pos = world.getPos(body.handle);
+				motion.velocity = world.getVelocity(body.handle);
+			});
+		}
 	public:
-		PhysicsHandler(gamePlayer::Player* player, gameMap::Map* map)
-			: player(player), map(map){}
+		// Creates the player entity at spawn
+		PhysicsHandler(ecs::Registry* registry, gameMap::Map* map, glm::vec2 spawn)
+			: registry(registry), map(map), world(map), ropes(map), projectiles(world) {
+			gameEntity::Runner runner;
+			gameEntity::PhysicsBody body = makeBody(spawn, runner);
+			player = registry->create(makeMotion(spawn), runner, body, gameEntity::Respawn{ spawn }, gameEntity::PlayerControl());
+			playerBody = body.handle;
+			world.addTrigger(KILL_ZONE_MIN, KILL_ZONE_MAX, TAG_KILL_ZONE);
+			bus.open<LandingEvent>();
+			bus.open<RespawnEvent>();
+			bus.open<EnemyDiedEvent>();
+			world.setEventBus(&bus);
+		}
+
+		World& getWorld() {
+			return world;
+		}
 
-		void updatePhysics(movementX movX) {
-			glm::vec2 newPos = player->pos + player->velocity;
+		const World& getWorld() const {
+			return world;
+		}
+
+		RopeSystem& getRopes() {
+			return ropes;
+		}
+
+		ProjectileSystem& getProjectiles() {
+			return projectiles;
+		}
+
+		// Spreads the world step and the projectile sweeps over the pool's threads and gives each of them a lane on the event bus
+		void setWorkerPool(jobs::WorkerPool* pool) {
+			world.setWorkerPool(pool);
+			projectiles.setWorkerPool(pool);
+			bus.setLanes(pool ? pool->threadCount() : 1);
+		}
+
+		// LandingEvents, RespawnEvents and EnemyDiedEvents of the last tick | Channels for more types can be opened
+		events::EventBus& getEvents() {
+			return bus;
+		}
+
+		ecs::Entity getPlayer() const {
+			return player;
+		}
+
+		glm::vec2 getPlayerPos() const {
+			return world.getPos(playerBody);
+		}
+
+		// Camera rectangle grown to hold the player | The player stays at full rate even off screen
+		void getView(glm::vec2& viewMin, glm::vec2& viewMax) const {
+			glm::vec2 playerPos = getPlayerPos();
+			viewMin = glm::min(VIEW_MIN, playerPos);
+			viewMax = glm::max(VIEW_MAX, playerPos);
+		}
+
+		bool isHanging() const {
+			return hanging;
+		}
+
+		// Enemy walking in direction (-1 or 1) | extra are more components, such as what a WalkerSystem thinks with
+		template<typename... Extra>
+		ecs::Entity spawnWalker(glm::vec2 pos, float direction, gameEntity::Runner runner = gameEntity::Runner(), Extra... extra) {
+			return registry->create(makeMotion(pos), runner, makeBody(pos, runner), gameEntity::Respawn{ pos }, gameEntity::Walker{ direction, 0.0f }, extra...);
+		}
 
-			if (map->getCollision(glm::uvec2(trunc(player->pos.x - player->width), trunc(newPos.y - player->height)))) {
-				newPos = glm::vec2(newPos.x, trunc(newPos.y) + 1);
+		// Removes an entity and its body | The player can't be despawned
+		void despawn(ecs::Entity entity) {
+			if (entity == player || !registry->alive(entity))
+				return;
+			if (const gameEntity::PhysicsBody* body = registry->get<gameEntity::PhysicsBody>(entity)) {
+				if (registry->has<gameEntity::Walker>(entity))
+					bus.publish(EnemyDiedEvent{ entity, world.getPos(body->handle) });
+				ropes.detach(body->handle);
+				world.removeBody(body->handle);
 			}
+			registry->destroy(entity);
+		}
+
+		// Hangs the player on the closest rope particle in reach | False if there is none
+		bool grabRope() {
+			uint32_t particle;
+			if (hanging || !ropes.findParticle(getPlayerPos(), GRAB_RADIUS, particle))
+				return false;
+			ropes.attach(playerBody, particle);
+			hanging = true;
+			return true;
+		}
+
+		// Lets go of the rope | The player keeps the swing's velocity
+		void releaseRope() {
+			if (!hanging)
+				return;
+			ropes.detach(playerBody);
+			hanging = false;
+		}
+
+		// What the grab key does | Lets go while hanging, grabs otherwise
+		void toggleRope() {
+			if (hanging)
+				releaseRope();
+			else
+				grabRope();
+		}
+
+		// World, entity and handler state | The map is saved by the SnapshotRing, as changes between frames
+		void save(StateBuffer& buffer) const {
+			world.save(buffer);
+			ropes.save(buffer);
+			projectiles.save(buffer);
+			registry->save(buffer);
+			buffer.write(hanging);
+		}
+
+		void restore(StateBuffer& buffer) {
+			world.restore(buffer);
+			ropes.restore(buffer);
+			projectiles.restore(buffer);
+			registry->restore(buffer);
+			buffer.read(hanging);
+		}
+
+		// Advances the simulation by one fixed tick of dt seconds
+		void updatePhysics(movementX movX, float dt) {
+			registry->each<gameEntity::PhysicsBody, gameEntity::Runner, gameEntity::PlayerControl>([&](ecs::Entity, gameEntity::PhysicsBody& body, gameEntity::Runner& runner, gameEntity::PlayerControl&) {
+				glm::vec2 velocity = world.getVelocity(body.handle);
+				// Input only pushes a hanging player, the rope decides where the swing goes
+				if (hanging)
+					world.setVelocity(body.handle, glm::vec2(velocity.x + SWING_ACCELERATION * movX * dt, velocity.y));
+				else
+					world.setVelocity(body.handle, glm::vec2(runner.runSpeed * movX, velocity.y));
+			});
+			walk();
+			glm::vec2 viewMin, viewMax;
+			getView(viewMin, viewMax);
+			world.setView(viewMin, viewMax);
+
+			world.step(dt);
+			ropes.step(world, dt);
+			projectiles.step(dt);
 
-			player->velocity = glm::vec2(player->runSpeed * movX, 0);
-			player->velocity += player->acceleration;
-			player->pos = newPos;
+			respawn();
+			syncMotion();
+			// Tick boundary | Events published since the last one become readable
+			bus.flush();
 		}
 	};
 }
\ No newline at end of file
@@ -0,0 +1,243 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include "World.hpp"
+#include "Query.hpp"
+#include "StateBuffer.hpp"
+
+
+namespace physics {
+
+	// Stable reference to a projectile | Low 20 bits are the slot, high 12 bits its generation
+	typedef uint32_t ProjectileHandle;
+	const ProjectileHandle INVALID_PROJECTILE = 0xFFFFFFFF;
+	const size_t DEFAULT_PROJECTILE_CAPACITY = 1024;
+
+	enum projectileEventType : uint8_t {PROJECTILE_HIT_TILE, PROJECTILE_HIT_BODY, PROJECTILE_EXPIRED};
+
+	struct ProjectileEvent {
+		ProjectileHandle projectile;
+		// Hit body | INVALID_BODY for tiles and expirations
+		BodyHandle body;
+		// Set by the game when spawning | Tells bullets, arrows and the like apart without a lookup
+		uint32_t tag;
+		// Where the projectile stopped and the face it hit | normal is 0 for expirations and projectiles spawned inside something
+		glm::vec2 pos, normal;
+		projectileEventType type;
+	};
+
+	// Short lived boxes that fly until they hit a tile or body or their lifetime runs out
+	// Storage is structure-of-arrays with a fixed capacity set up front, live projectiles dense in [0, live) | Spawning and
+	// despawning only move entries around, they never allocate | Hits and expirations land in an event buffer that works like
+	// the trigger one | Projectiles run in float in both numeric modes
+	class ProjectileSystem {
+	private:
+		static const uint32_t SLOT_BITS = 20;
+		static const uint32_t SLOT_MASK = (1 << SLOT_BITS) - 1;
+
+		WorldQuery query;
+		size_t capacity, eventCapacity;
+		uint32_t live = 0;
+
+		// Slot -> dense index and back | Slots stay put while dense indices move on despawn
+		std::vector<uint32_t> slotIndex, slotGeneration, denseSlot, freeSlots;
+
+		// Dense projectile data | Index i of every array belongs to the same projectile
+		std::vector<float> posX, posY, velX, velY, halfW, halfH;
+		// Seconds left
+		std::vector<float> life;
+		std::vector<BodyHandle> owner;
+		std::vector<uint32_t> tag;
+
+		// Per step scratch, sized to the capacity
+		std::vector<BoxCast> casts;
+		std::vector<CastHit> hits;
+		std::vector<uint8_t> dead;
+		std::vector<ProjectileEvent> events;
+
+		static ProjectileHandle makeHandle(uint32_t slot, uint32_t generation) {
+			return (generation << SLOT_BITS) | slot;
+		}
+
+		void emit(uint32_t i, projectileEventType type, glm::vec2 pos, glm::vec2 normal, BodyHandle body) {
+			if (events.size() == eventCapacity) {
+				++dropped;
+				return;
+			}
+			events.push_back({ handle(i), body, tag[i], pos, normal, type });
+		}
+
+		// Swaps the last live projectile into i | Frees the slot of the one at i
+		void removeAt(uint32_t i) {
+			uint32_t slot = denseSlot[i];
+			slotGeneration[slot] = (slotGeneration[slot] + 1) & ((1 << (32 - SLOT_BITS)) - 1);
+			freeSlots.push_back(slot);
+
+			uint32_t last = --live;
+			if (i != last) {
+				posX[i] = posX[last]; posY[i] = posY[last];
+				velX[i] = velX[last]; velY[i] = velY[last];
+				halfW[i] = halfW[last]; halfH[i] = halfH[last];
+				life[i] = life[last];
+				owner[i] = owner[last];
+				tag[i] = tag[last];
+				denseSlot[i] = denseSlot[last];
+				slotIndex[denseSlot[i]] = i;
+			}
+		}
+	public:
+		// Events that didn't fit into the buffer during the last step
+		size_t dropped = 0;
+		// Spawns turned down because the pool was full, since the start
+		size_t refused = 0;
+		// Units per second squared | Straight flight by default
+		glm::vec2 gravity = glm::vec2(0);
+
+		// Bodies are found through world's broadphase, tiles through its map | Batches run on the pool if there is one
+		ProjectileSystem(const World& world, size_t capacity = DEFAULT_PROJECTILE_CAPACITY, size_t eventCapacity = DEFAULT_EVENT_CAPACITY, jobs::WorkerPool* pool = nullptr)
+			: query(world, pool), capacity(std::min(capacity, static_cast<size_t>(SLOT_MASK))), eventCapacity(eventCapacity) {
+			slotIndex.resize(this->capacity);
+			slotGeneration.assign(this->capacity, 0);
+			denseSlot.resize(this->capacity);
+			freeSlots.reserve(this->capacity);
+			for (size_t slot = this->capacity; slot-- > 0;)
+				freeSlots.push_back(static_cast<uint32_t>(slot));
+			for (std::vector<float>* a : { &posX, &posY, &velX, &velY, &halfW, &halfH, &life })
+				a->resize(this->capacity);
+			owner.resize(this->capacity);
+			tag.resize(this->capacity);
+			casts.resize(this->capacity);
+			hits.resize(this->capacity);
+			dead.resize(this->capacity);
+			events.reserve(eventCapacity);
+		}
+
+		// Spreads the sweeps of a step over the pool's threads | nullptr sweeps on the calling thread
+		void setWorkerPool(jobs::WorkerPool* pool) {
+			query.setWorkerPool(pool);
+		}
+
+		size_t size() const {
+			return live;
+		}
+
+		size_t getCapacity() const {
+			return capacity;
+		}
+
+		// owner is left out of the hit test, usually the shooter | INVALID_PROJECTILE if the pool is full
+		ProjectileHandle spawn(glm::vec2 pos, glm::vec2 velocity, float lifetime, BodyHandle owner = INVALID_BODY, uint32_t tag = 0, glm::vec2 halfExtents = glm::vec2(0.05f)) {
+			if (freeSlots.empty()) {
+				++refused;
+				return INVALID_PROJECTILE;
+			}
+			uint32_t slot = freeSlots.back();
+			freeSlots.pop_back();
+			uint32_t i = live++;
+			slotIndex[slot] = i;
+			denseSlot[i] = slot;
+			posX[i] = pos.x; posY[i] = pos.y;
+			velX[i] = velocity.x; velY[i] = velocity.y;
+			halfW[i] = halfExtents.x; halfH[i] = halfExtents.y;
+			life[i] = lifetime;
+			this->owner[i] = owner;
+			this->tag[i] = tag;
+			return makeHandle(slot, slotGeneration[slot]);
+		}
+
+		// Removes a projectile without an event
+		void despawn(ProjectileHandle projectile) {
+			if (isAlive(projectile))
+				removeAt(slotIndex[projectile & SLOT_MASK]);
+		}
+
+		bool isAlive(ProjectileHandle projectile) const {
+			uint32_t slot = projectile & SLOT_MASK;
+			return slot < capacity && slotGeneration[slot] == projectile >> SLOT_BITS && slotIndex[slot] < live && denseSlot[slotIndex[slot]] == slot;
+		}
+
+		// Handle of the projectile at a dense index
+		ProjectileHandle handle(uint32_t i) const {
+			return makeHandle(denseSlot[i], slotGeneration[denseSlot[i]]);
+		}
+
+		glm::vec2 getPos(ProjectileHandle projectile) const {
+			uint32_t i = slotIndex[projectile & SLOT_MASK];
+			return glm::vec2(posX[i], posY[i]);
+		}
+
+		// Events of the last step | Valid until the next one
+		const std::vector<ProjectileEvent>& getEvents() const {
+			return events;
+		}
+
+		// Runs after world.step, so the broadphase holds this tick's bodies
+		void step(float dt) {
+			events.clear();
+			dropped = 0;
+
+			// Gravity and lifetime | Expired projectiles are only counted down here, the hit loop below despawns them
+			float gx = gravity.x * dt, gy = gravity.y * dt;
+			float* __restrict vx = velX.data();
+			float* __restrict vy = velY.data();
+			float* __restrict left = life.data();
+			for (uint32_t i = 0; i < live; ++i) {
+				vx[i] += gx;
+				vy[i] += gy;
+				left[i] -= dt;
+			}
+
+			for (uint32_t i = 0; i < live; ++i)
+				casts[i] = { glm::vec2(posX[i], posY[i]), glm::vec2(halfW[i], halfH[i]), glm::vec2(velX[i], velY[i]) * dt, owner[i] };
+			query.boxCast(casts.data(), live, hits.data());
+
+			// Events go out in dense order, despawns wait until all of them are out
+			for (uint32_t i = 0; i < live; ++i) {
+				const CastHit& hit = hits[i];
+				glm::vec2 pos = casts[i].center + casts[i].delta * hit.fraction;
+				posX[i] = pos.x;
+				posY[i] = pos.y;
+				dead[i] = hit.hit || life[i] <= 0;
+				if (hit.hit)
+					emit(i, hit.body == INVALID_BODY ? PROJECTILE_HIT_TILE : PROJECTILE_HIT_BODY, pos, hit.normal, hit.body);
+				else if (life[i] <= 0)
+					emit(i, PROJECTILE_EXPIRED, pos, glm::vec2(0), INVALID_BODY);
+			}
+			// Backwards, so every projectile swapped in was already looked at and lives
+			for (uint32_t i = live; i-- > 0;) {
+				if (dead[i])
+					removeAt(i);
+			}
+		}
+
+		// Live projectiles and slots | Events are left out, they only last until the next step
+		// Only the live part of the dense arrays is copied, restoring never allocates
+		void save(StateBuffer& buffer) const {
+			buffer.write(live);
+			buffer.writeArray(freeSlots);
+			buffer.writeRange(slotIndex.data(), capacity);
+			buffer.writeRange(slotGeneration.data(), capacity);
+			buffer.writeRange(denseSlot.data(), live);
+			const std::vector<float>* arrays[] = { &posX, &posY, &velX, &velY, &halfW, &halfH, &life };
+			for (const std::vector<float>* a : arrays)
+				buffer.writeRange(a->data(), live);
+			buffer.writeRange(owner.data(), live);
+			buffer.writeRange(tag.data(), live);
+		}
+
+		void restore(StateBuffer& buffer) {
+			buffer.read(live);
+			buffer.readArray(freeSlots);
+			buffer.readRange(slotIndex.data(), capacity);
+			buffer.readRange(slotGeneration.data(), capacity);
+			buffer.readRange(denseSlot.data(), live);
+			std::vector<float>* arrays[] = { &posX, &posY, &velX, &velY, &halfW, &halfH, &life };
+			for (std::vector<float>* a : arrays)
+				buffer.readRange(a->data(), live);
+			buffer.readRange(owner.data(), live);
+			buffer.readRange(tag.data(), live);
+		}
+	};
+}
\ No newline at end of file
@@ -0,0 +1,229 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include "Map.hpp"
+#include "Collision.hpp"
+#include "World.hpp"
+#include "Jobs.hpp"
+
+
+namespace physics {
+
+	// Queries per task when a batch is spread over the worker pool
+	const size_t QUERY_BATCH = 64;
+
+	// Is there room for this box | ignore is left out of the body test, usually the asking body itself
+	struct BoxQuery {
+		glm::vec2 center, halfExtents;
+		BodyHandle ignore;
+	};
+
+	// Box moved by delta, stopped by the first tile or body in the way
+	struct BoxCast {
+		glm::vec2 center, halfExtents, delta;
+		BodyHandle ignore;
+	};
+
+	struct CastHit {
+		bool hit;
+		// Fraction of delta travelled before the hit | 0 if the box starts out overlapping
+		float fraction;
+		glm::vec2 normal;
+		// INVALID_BODY for tiles
+		BodyHandle body;
+	};
+
+	struct CircleQuery {
+		glm::vec2 center;
+		float radius;
+	};
+
+	// Slice of a shared result list
+	struct QueryRange {
+		uint32_t first, count;
+	};
+
+	// Batched read-only queries against a world's tiles and bodies | Results are written to caller owned arrays
+	// Tiles are found through the map's collision bitset, bodies through the world's broadphase
+	class WorldQuery {
+	private:
+		const World& world;
+		jobs::WorkerPool* pool;
+
+		// Per batch scratch | Batches never share one, so they can run on any thread
+		std::vector<std::vector<uint32_t>> candidates;
+		std::vector<std::vector<BodyHandle>> batchBodies;
+
+		template<typename F>
+		void forBatches(size_t count, F func) {
+			size_t batches = (count + QUERY_BATCH - 1) / QUERY_BATCH;
+			if (candidates.size() < batches) {
+				candidates.resize(batches);
+				batchBodies.resize(batches);
+			}
+			if (pool) {
+				pool->parallelFor(count, QUERY_BATCH, func);
+				return;
+			}
+			for (size_t begin = 0; begin < count; begin += QUERY_BATCH)
+				func(begin, std::min(count, begin + QUERY_BATCH));
+		}
+
+		glm::vec2 bodyMin(uint32_t i) const {
+			return glm::vec2(toFloat(world.posX[i] - world.halfW[i]), toFloat(world.posY[i] - world.halfH[i]));
+		}
+
+		glm::vec2 bodyMax(uint32_t i) const {
+			return glm::vec2(toFloat(world.posX[i] + world.halfW[i]), toFloat(world.posY[i] + world.halfH[i]));
+		}
+
+		// Broadphase candidates for [min, max] | Padded by the drift since the last update so moved bodies aren't missed
+		// Candidates past the last dense index belong to bodies removed since then and are dropped
+		void findBodies(const BodyBounds& bounds, glm::vec2 min, glm::vec2 max, float drift, std::vector<uint32_t>& found) const {
+			found.clear();
+			world.getBroadphase().query(bounds, min - glm::vec2(drift), max + glm::vec2(drift), found);
+			uint32_t count = static_cast<uint32_t>(world.size());
+			found.erase(std::remove_if(found.begin(), found.end(), [count](uint32_t i) { return i >= count; }), found.end());
+		}
+
+		// Walled cells overlapping the box | One-way platforms never block
+		bool tilesBlock(glm::vec2 min, glm::vec2 max) const {
+			real minX = toReal(min.x), minY = toReal(min.y), maxX = toReal(max.x);
+			const gameMap::Map& map = world.getMap();
+			return map.forSolidCells(floorToInt(minX + SKIN), floorToInt(minY + SKIN), ceilToInt(maxX - SKIN) - 1, ceilToInt(toReal(max.y) - SKIN) - 1, [&](int x, int y) {
+				const gameMap::CollisionShape& shape = map.shapeAt(x, y);
+				return shape.walls && minY + SKIN < real(y) + surfaceTop(shape, x, minX, maxX);
+			});
+		}
+
+		// Moving box against a fixed one, both as min and max corners | Slab test on the Minkowski sum
+		static bool castAgainst(glm::vec2 min, glm::vec2 max, glm::vec2 delta, glm::vec2 boxMin, glm::vec2 boxMax, CastHit& hit) {
+			float enter = -1.0f, exit = 1.0f;
+			glm::vec2 normal(0);
+			for (int axis = 0; axis < 2; ++axis) {
+				float lower = boxMin[axis] - max[axis], upper = boxMax[axis] - min[axis];
+				if (delta[axis] == 0.0f) {
+					if (lower >= 0.0f || upper <= 0.0f)
+						return false;
+					continue;
+				}
+				float t0 = lower / delta[axis], t1 = upper / delta[axis];
+				if (t0 > t1)
+					std::swap(t0, t1);
+				if (t0 > enter) {
+					enter = t0;
+					normal = glm::vec2(0);
+					normal[axis] = delta[axis] > 0.0f ? -1.0f : 1.0f;
+				}
+				exit = std::min(exit, t1);
+			}
+			if (enter >= exit || exit <= 0.0f || enter >= hit.fraction)
+				return false;
+			hit.fraction = std::max(enter, 0.0f);
+			hit.normal = enter > 0.0f ? normal : glm::vec2(0);
+			return true;
+		}
+	public:
+		WorldQuery(const World& world, jobs::WorkerPool* pool = nullptr)
+			: world(world), pool(pool) {}
+
+		// nullptr runs every batch on the calling thread
+		void setWorkerPool(jobs::WorkerPool* workerPool) {
+			pool = workerPool;
+		}
+
+		// free[i] is true if queries[i] overlaps neither a walled tile nor a body other than its ignore
+		void roomToStand(const BoxQuery* queries, size_t count, bool* free) {
+			BodyBounds bounds = world.bounds();
+			float drift = world.broadphaseDrift();
+			forBatches(count, [&](size_t begin, size_t end) {
+				std::vector<uint32_t>& found = candidates[begin / QUERY_BATCH];
+				for (size_t q = begin; q < end; ++q) {
+					glm::vec2 min = queries[q].center - queries[q].halfExtents;
+					glm::vec2 max = queries[q].center + queries[q].halfExtents;
+					bool blocked = tilesBlock(min, max);
+					if (!blocked) {
+						findBodies(bounds, min, max, drift, found);
+						for (uint32_t i : found) {
+							if (world.handle(i) != queries[q].ignore && overlaps(min, max, bodyMin(i), bodyMax(i))) {
+								blocked = true;
+								break;
+							}
+						}
+					}
+					free[q] = !blocked;
+				}
+			});
+		}
+
+		// Earliest hit of every cast | Shaped tiles count as their bounding box
+		void boxCast(const BoxCast* casts, size_t count, CastHit* hits) {
+			BodyBounds bounds = world.bounds();
+			float drift = world.broadphaseDrift();
+			const gameMap::Map& map = world.getMap();
+			forBatches(count, [&](size_t begin, size_t end) {
+				std::vector<uint32_t>& found = candidates[begin / QUERY_BATCH];
+				for (size_t q = begin; q < end; ++q) {
+					const BoxCast& c = casts[q];
+					CastHit& hit = hits[q];
+					hit = { false, 1.0f, glm::vec2(0), INVALID_BODY };
+					glm::vec2 min = c.center - c.halfExtents, max = c.center + c.halfExtents;
+					glm::vec2 sweptMin = glm::min(min, min + c.delta), sweptMax = glm::max(max, max + c.delta);
+
+					map.forSolidCells(floorToInt(sweptMin.x), floorToInt(sweptMin.y), ceilToInt(sweptMax.x) - 1, ceilToInt(sweptMax.y) - 1, [&](int x, int y) {
+						const gameMap::CollisionShape& shape = map.shapeAt(x, y);
+						if (shape.walls && castAgainst(min, max, c.delta, glm::vec2(x, y), glm::vec2(x + 1, y + toFloat(std::max(shape.left, shape.right))), hit)) {
+							hit.hit = true;
+							hit.body = INVALID_BODY;
+						}
+						return false;
+					});
+
+					findBodies(bounds, sweptMin, sweptMax, drift, found);
+					for (uint32_t i : found) {
+						BodyHandle body = world.handle(i);
+						if (body != c.ignore && castAgainst(min, max, c.delta, bodyMin(i), bodyMax(i), hit)) {
+							hit.hit = true;
+							hit.body = body;
+						}
+					}
+				}
+			});
+		}
+
+		// Bodies touching each circle | ranges[i] points into bodies, which is cleared first
+		void circleOverlap(const CircleQuery* circles, size_t count, QueryRange* ranges, std::vector<BodyHandle>& bodies) {
+			BodyBounds bounds = world.bounds();
+			float drift = world.broadphaseDrift();
+			forBatches(count, [&](size_t begin, size_t end) {
+				std::vector<uint32_t>& found = candidates[begin / QUERY_BATCH];
+				std::vector<BodyHandle>& out = batchBodies[begin / QUERY_BATCH];
+				out.clear();
+				for (size_t q = begin; q < end; ++q) {
+					const CircleQuery& c = circles[q];
+					ranges[q].first = static_cast<uint32_t>(out.size());
+					findBodies(bounds, c.center - glm::vec2(c.radius), c.center + glm::vec2(c.radius), drift, found);
+					for (uint32_t i : found) {
+						glm::vec2 closest = glm::clamp(c.center, bodyMin(i), bodyMax(i));
+						glm::vec2 d = closest - c.center;
+						if (d.x * d.x + d.y * d.y < c.radius * c.radius)
+							out.push_back(world.handle(i));
+					}
+					ranges[q].count = static_cast<uint32_t>(out.size()) - ranges[q].first;
+				}
+			});
+
+			// Batch lists are appended in batch order, so the result doesn't depend on the thread count
+			bodies.clear();
+			for (size_t begin = 0; begin < count; begin += QUERY_BATCH) {
+				const std::vector<BodyHandle>& out = batchBodies[begin / QUERY_BATCH];
+				uint32_t offset = static_cast<uint32_t>(bodies.size());
+				for (size_t q = begin; q < std::min(count, begin + QUERY_BATCH); ++q)
+					ranges[q].first += offset;
+				bodies.insert(bodies.end(), out.begin(), out.end());
+			}
+		}
+	};
+}
\ No newline at end of file
@@ -0,0 +1,137 @@
+#pragma once
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <own/helper.hpp>
+#include "Map.hpp"
+#include "Physics.hpp"
+
+
+// Input recordings with a state hash per tick | Written with --record <file>, checked headless with --replay <file>
+// File layout: header line "replay <numeric mode> <tick rate> <start x> <start y>", then one "<movX> <hash>" line per tick
+// Ticks that began with a press of the grab key end their line with " grab"
+namespace replay {
+
+	class Recorder {
+	private:
+		std::ofstream file;
+	public:
+		Recorder(const std::string& path, float tickRate, glm::vec2 start)
+			: file(path) {
+			if (!file)
+				console::printError("Recorder: Opening file failed | [" + path + "]");
+			file << std::setprecision(9) << "replay " << physics::NUMERIC_MODE << " " << tickRate << " " << start.x << " " << start.y << "\n";
+		}
+
+		void record(physics::movementX movX, bool grab, uint64_t hash) {
+			file << static_cast<int>(movX) << " " << hash << (grab ? " grab\n" : "\n");
+		}
+	};
+
+	// Path of the recording that comes with the game | Fixed point, so every build reproduces its hashes
+	const char* const DEMO_RECORDING = "demo_fixed.replay";
+
+	struct Recording {
+		std::string mode;
+		float tickRate;
+		glm::vec2 start;
+		std::vector<physics::movementX> inputs;
+		std::vector<uint8_t> grabs;
+		std::vector<uint64_t> hashes;
+	};
+
+	inline bool load(const std::string& path, Recording& recording) {
+		std::ifstream file(path);
+		std::string magic;
+		if (!(file >> magic >> recording.mode >> recording.tickRate >> recording.start.x >> recording.start.y) || magic != "replay") {
+			console::printError("Replay: Reading header failed | [" + path + "]");
+			return false;
+		}
+		std::string line;
+		while (std::getline(file, line)) {
+			std::istringstream fields(line);
+			int movX;
+			uint64_t hash;
+			std::string grab;
+			if (!(fields >> movX >> hash))
+				continue;
+			fields >> grab;
+			recording.inputs.push_back(static_cast<physics::movementX>(movX));
+			recording.grabs.push_back(grab == "grab");
+			recording.hashes.push_back(hash);
+		}
+		return true;
+	}
+
+	// Runs the recorded inputs on the demo level | Returns the state hash after every tick
+	inline std::vector<uint64_t> simulate(const Recording& recording) {
+		gameMap::Map map(nullptr, nullptr, nullptr);
+		gameMap::BlockHandle solidBlock = map.addBlockType();
+		gameMap::buildDemoLevel(map, solidBlock);
+		ecs::Registry registry;
+		physics::PhysicsHandler physics(&registry, &map, recording.start);
+		physics::hangDemoRopes(physics.getRopes());
+		physics::TickClock clock(recording.tickRate);
+
+		std::vector<uint64_t> hashes;
+		hashes.reserve(recording.inputs.size());
+		for (size_t tick = 0; tick < recording.inputs.size(); ++tick) {
+			if (recording.grabs[tick])
+				physics.toggleRope();
+			physics.updatePhysics(recording.inputs[tick], clock.tickTime);
+			hashes.push_back(physics.getWorld().stateHash());
+		}
+		return hashes;
+	}
+
+	// Index of the first tick whose hashes differ | size of the shorter list if none does
+	inline size_t firstDifference(const std::vector<uint64_t>& a, const std::vector<uint64_t>& b) {
+		size_t tick = 0;
+		while (tick < a.size() && tick < b.size() && a[tick] == b[tick])
+			++tick;
+		return tick;
+	}
+
+	// Re-simulates a recording and compares the state hash after every tick | Returns the process exit code
+	inline int verify(const std::string& path) {
+		Recording recording;
+		if (!load(path, recording))
+			return 1;
+		if (recording.mode != physics::NUMERIC_MODE) {
+			console::printError("Replay: Recorded with " + recording.mode + " physics, this build runs " + physics::NUMERIC_MODE);
+			return 1;
+		}
+
+		std::vector<uint64_t> hashes = simulate(recording);
+		size_t tick = firstDifference(hashes, recording.hashes);
+		if (tick < hashes.size()) {
+			console::printError("Replay: Diverged at tick " + std::to_string(tick)
+				+ " | expected " + std::to_string(recording.hashes[tick]) + " got " + std::to_string(hashes[tick]));
+			return 1;
+		}
+
+		console::printInfo("Replay: " + std::to_string(hashes.size()) + " ticks match | " + physics::NUMERIC_MODE + " physics");
+		return 0;
+	}
+
+	// Checks the recording that comes with the game | Float builds can't reproduce fixed point hashes,
+	// so they run its inputs twice and compare the two runs instead | Returns the process exit code
+	inline int verifyDemo() {
+		Recording recording;
+		if (!load(DEMO_RECORDING, recording))
+			return 1;
+		if (recording.mode == physics::NUMERIC_MODE)
+			return verify(DEMO_RECORDING);
+
+		std::vector<uint64_t> first = simulate(recording), second = simulate(recording);
+		size_t tick = firstDifference(first, second);
+		if (tick < first.size()) {
+			console::printError("Replay: Two runs of the same inputs diverged at tick " + std::to_string(tick));
+			return 1;
+		}
+		console::printInfo("Replay: " + std::to_string(first.size()) + " ticks of " + recording.mode + " inputs run the same twice | " + physics::NUMERIC_MODE + " physics");
+		return 0;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,419 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cfloat>
+#include <algorithm>
+#include <emmintrin.h>
+#include <glm/glm.hpp>
+#include <own/renderutil.hpp>
+#include "Map.hpp"
+#include "World.hpp"
+#include "StateBuffer.hpp"
+
+
+namespace physics {
+
+	// Distance constraint passes per tick
+	const int ROPE_ITERATIONS = 8;
+	// Share of the last tick's motion a particle keeps | Stops ropes from swinging forever
+	const float ROPE_DAMPING = 0.995f;
+	// Share of its sideways motion a particle keeps while lying on a surface
+	const float ROPE_FRICTION = 0.5f;
+	// Gap particles are pushed out of cells to
+	const float ROPE_SKIN = 1e-3f;
+	// Floats per SSE register | Ropes start on a multiple of it and the arrays are padded to it
+	const uint32_t ROPE_LANES = 4;
+	const glm::vec4 ROPE_COLOR(0.6f, 0.45f, 0.25f, 1.0f);
+
+	// Ropes, chains and bridges as Verlet particles joined by distance constraints
+	// Particles of all ropes share one set of flat arrays that SSE kernels run over four at a time | Ropes run in float in both numeric modes
+	class RopeSystem {
+	private:
+		// Particles [first, first + count) | first is a multiple of ROPE_LANES, the gap up to the next rope is padding
+		struct Rope {
+			uint32_t first, count;
+			bool pinStart, pinEnd;
+		};
+
+		// A body swinging on a particle | The particle takes the body's place in the rope for the step
+		struct Attachment {
+			BodyHandle body;
+			uint32_t particle;
+			float particleInvMass;
+		};
+
+		gameMap::Map* map;
+		std::vector<Rope> ropes;
+		std::vector<Attachment> attachments;
+		// Particles including padding | The arrays hold ROPE_LANES more so kernels can read one past the end
+		uint32_t used = 0;
+
+		// Particle arrays | Index i belongs to particle i
+		std::vector<float> posX, posY, prevX, prevY;
+		// 0 pins a particle in place, padding is pinned too
+		std::vector<float> invMass;
+		// Constraint between particle i and i + 1 | restSq is the squared rest length, 0 after the last particle of a rope
+		std::vector<float> restSq;
+		// 1 for constraints solved in the even and odd pass | Neighbouring constraints share a particle, so they never run in the same pass
+		std::vector<float> evenLink, oddLink;
+		// Share of a link's error each side takes in the even and odd pass | Rebuilt every step, hanging bodies change the masses
+		std::vector<float> evenWeight, oddWeight;
+		// Length of rope to the pinned start and end | Hard limits on top of the links, they keep long ropes from stretching
+		// under their own weight with few iterations | FLT_MAX where there is no pinned end
+		std::vector<float> reachStart, reachEnd;
+		// Correction of constraint i, stored at i + 1 | Entry 0 stays 0 so the apply loop needs no bounds check
+		std::vector<float> fixX, fixY;
+
+		// Grows every array to hold size particles, new ones as pinned padding
+		void resize(uint32_t size) {
+			for (std::vector<float>* a : { &posX, &posY, &prevX, &prevY, &invMass, &restSq, &evenLink, &oddLink, &evenWeight, &oddWeight })
+				a->resize(size + ROPE_LANES, 0.0f);
+			reachStart.resize(size + ROPE_LANES, FLT_MAX);
+			reachEnd.resize(size + ROPE_LANES, FLT_MAX);
+			fixX.resize(size + ROPE_LANES + 1, 0.0f);
+			fixY.resize(size + ROPE_LANES + 1, 0.0f);
+		}
+
+		// Verlet step | Pinned particles are masked out instead of skipped
+		void integrate(float dt, glm::vec2 gravity) {
+			float* px = posX.data();
+			float* py = posY.data();
+			float* ox = prevX.data();
+			float* oy = prevY.data();
+			const float* w = invMass.data();
+			const __m128 damping = _mm_set1_ps(ROPE_DAMPING);
+			const __m128 gx = _mm_set1_ps(gravity.x * dt * dt), gy = _mm_set1_ps(gravity.y * dt * dt);
+
+			for (uint32_t i = 0; i < used; i += ROPE_LANES) {
+				__m128 moving = _mm_cmpgt_ps(_mm_loadu_ps(w + i), _mm_setzero_ps());
+				__m128 x = _mm_loadu_ps(px + i), y = _mm_loadu_ps(py + i);
+				__m128 stepX = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(x, _mm_loadu_ps(ox + i)), damping), gx);
+				__m128 stepY = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(y, _mm_loadu_ps(oy + i)), damping), gy);
+				_mm_storeu_ps(ox + i, x);
+				_mm_storeu_ps(oy + i, y);
+				_mm_storeu_ps(px + i, _mm_add_ps(x, _mm_and_ps(moving, stepX)));
+				_mm_storeu_ps(py + i, _mm_add_ps(y, _mm_and_ps(moving, stepY)));
+			}
+		}
+
+		// 2 / (w[i] + w[i + 1]) per link, masked to the links of each pass
+		void updateWeights() {
+			const float* w = invMass.data();
+			const float* even = evenLink.data();
+			const float* odd = oddLink.data();
+			float* evenOut = evenWeight.data();
+			float* oddOut = oddWeight.data();
+			const __m128 two = _mm_set1_ps(2.0f), tiny = _mm_set1_ps(1e-20f);
+
+			for (uint32_t i = 0; i < used; i += ROPE_LANES) {
+				__m128 share = _mm_div_ps(two, _mm_add_ps(_mm_add_ps(_mm_loadu_ps(w + i), _mm_loadu_ps(w + i + 1)), tiny));
+				_mm_storeu_ps(evenOut + i, _mm_mul_ps(_mm_loadu_ps(even + i), share));
+				_mm_storeu_ps(oddOut + i, _mm_mul_ps(_mm_loadu_ps(odd + i), share));
+			}
+		}
+
+		// One red or black pass | Corrections first, then every particle takes the ones of its two constraints
+		// Jakobsen's sqrt free distance fix, (d - r) / d is approximated around the rest length
+		void solvePass(const std::vector<float>& weight) {
+			float* px = posX.data();
+			float* py = posY.data();
+			const float* w = invMass.data();
+			const float* r = restSq.data();
+			const float* share = weight.data();
+			float* fx = fixX.data();
+			float* fy = fixY.data();
+			const __m128 half = _mm_set1_ps(0.5f), tiny = _mm_set1_ps(1e-20f);
+
+			for (uint32_t i = 0; i < used; i += ROPE_LANES) {
+				__m128 dx = _mm_sub_ps(_mm_loadu_ps(px + i + 1), _mm_loadu_ps(px + i));
+				__m128 dy = _mm_sub_ps(_mm_loadu_ps(py + i + 1), _mm_loadu_ps(py + i));
+				__m128 rest = _mm_loadu_ps(r + i);
+				__m128 lengthSq = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+				// tiny keeps unlinked padding, which sits on one spot, from dividing 0 by 0
+				__m128 error = _mm_sub_ps(_mm_div_ps(rest, _mm_add_ps(_mm_add_ps(lengthSq, rest), tiny)), half);
+				__m128 scale = _mm_mul_ps(_mm_loadu_ps(share + i), error);
+				_mm_storeu_ps(fx + i + 1, _mm_mul_ps(dx, scale));
+				_mm_storeu_ps(fy + i + 1, _mm_mul_ps(dy, scale));
+			}
+
+			for (uint32_t i = 0; i < used; i += ROPE_LANES) {
+				__m128 weight = _mm_loadu_ps(w + i);
+				__m128 moveX = _mm_sub_ps(_mm_loadu_ps(fx + i), _mm_loadu_ps(fx + i + 1));
+				__m128 moveY = _mm_sub_ps(_mm_loadu_ps(fy + i), _mm_loadu_ps(fy + i + 1));
+				_mm_storeu_ps(px + i, _mm_add_ps(_mm_loadu_ps(px + i), _mm_mul_ps(weight, moveX)));
+				_mm_storeu_ps(py + i, _mm_add_ps(_mm_loadu_ps(py + i), _mm_mul_ps(weight, moveY)));
+			}
+		}
+
+		// Pulls the particles of a rope back that got further from a pinned end than the rope between them is long
+		void tether(const Rope& rope, uint32_t anchor, const std::vector<float>& reach) {
+			float* px = posX.data();
+			float* py = posY.data();
+			const float* r = reach.data();
+			const __m128 ax = _mm_set1_ps(px[anchor]), ay = _mm_set1_ps(py[anchor]);
+			const __m128 one = _mm_set1_ps(1.0f), tiny = _mm_set1_ps(1e-12f);
+
+			for (uint32_t i = rope.first; i < rope.first + rope.count; i += ROPE_LANES) {
+				__m128 dx = _mm_sub_ps(_mm_loadu_ps(px + i), ax);
+				__m128 dy = _mm_sub_ps(_mm_loadu_ps(py + i), ay);
+				__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), tiny));
+				__m128 scale = _mm_min_ps(one, _mm_div_ps(_mm_loadu_ps(r + i), length));
+				_mm_storeu_ps(px + i, _mm_add_ps(ax, _mm_mul_ps(dx, scale)));
+				_mm_storeu_ps(py + i, _mm_add_ps(ay, _mm_mul_ps(dy, scale)));
+			}
+		}
+
+		// Pushes particles out of the cell they ended up in, through the nearest open face
+		// Only the top face counts for one-way platforms, and only when coming from above
+		void collideTiles() {
+			for (uint32_t i = 0; i < used; ++i) {
+				if (invMass[i] <= 0)
+					continue;
+				int cx = floorToInt(posX[i]);
+				int cy = floorToInt(posY[i]);
+				const gameMap::CollisionShape& shape = map->shapeAt(cx, cy);
+				if (!shape.top)
+					continue;
+
+				float left = toFloat(shape.left), right = toFloat(shape.right);
+				float surface = cy + left + (right - left) * (posX[i] - cx);
+				if (posY[i] >= surface)
+					continue;
+				bool fromAbove = prevY[i] >= surface - ROPE_SKIN;
+				if (!shape.walls && !fromAbove)
+					continue;
+
+				float up = surface - posY[i];
+				float toLeft = posX[i] - cx, toRight = cx + 1 - posX[i], down = posY[i] - cy;
+				if (fromAbove || !shape.walls || up <= std::min(std::min(toLeft, toRight), down)) {
+					posY[i] = surface + ROPE_SKIN;
+					prevX[i] = posX[i] - (posX[i] - prevX[i]) * ROPE_FRICTION;
+				}
+				else if (down <= std::min(toLeft, toRight)) {
+					posY[i] = cy - ROPE_SKIN;
+				}
+				else if (toLeft <= toRight) {
+					posX[i] = cx - ROPE_SKIN;
+				}
+				else {
+					posX[i] = cx + 1 + ROPE_SKIN;
+				}
+			}
+		}
+	public:
+		// Units per second squared
+		glm::vec2 gravity = DEFAULT_GRAVITY;
+		int iterations = ROPE_ITERATIONS;
+
+		RopeSystem(gameMap::Map* map)
+			: map(map) {
+			resize(0);
+		}
+
+		// Particles including padding
+		size_t particleCount() const {
+			return used;
+		}
+
+		size_t ropeCount() const {
+			return ropes.size();
+		}
+
+		// Straight rope of segments pieces from start to end | Pinned ends stay put, a bridge pins both
+		// particleMass is per particle, bodies hanging on the rope should outweigh it
+		uint32_t addRope(glm::vec2 start, glm::vec2 end, int segments, bool pinStart, bool pinEnd = false, float particleMass = 0.1f) {
+			Rope rope = { used, static_cast<uint32_t>(segments + 1), pinStart, pinEnd };
+			used += (rope.count + ROPE_LANES - 1) / ROPE_LANES * ROPE_LANES;
+			resize(used);
+
+			float rest = glm::length(end - start) / segments;
+			for (int k = 0; k <= segments; ++k) {
+				uint32_t i = rope.first + k;
+				glm::vec2 p = glm::mix(start, end, float(k) / segments);
+				bool pinned = (k == 0 && pinStart) || (k == segments && pinEnd);
+				posX[i] = prevX[i] = p.x;
+				posY[i] = prevY[i] = p.y;
+				invMass[i] = pinned ? 0.0f : 1.0f / particleMass;
+				restSq[i] = k < segments ? rest * rest : 0.0f;
+				evenLink[i] = k < segments && i % 2 == 0 ? 1.0f : 0.0f;
+				oddLink[i] = k < segments && i % 2 == 1 ? 1.0f : 0.0f;
+				reachStart[i] = pinStart ? rest * k : FLT_MAX;
+				reachEnd[i] = pinEnd ? rest * (segments - k) : FLT_MAX;
+			}
+			ropes.push_back(rope);
+			return static_cast<uint32_t>(ropes.size()) - 1;
+		}
+
+		// Particle index of a rope's k-th particle
+		uint32_t particle(uint32_t rope, uint32_t k) const {
+			return ropes[rope].first + k;
+		}
+
+		// Particles of a rope without its padding
+		uint32_t ropeSize(uint32_t rope) const {
+			return ropes[rope].count;
+		}
+
+		glm::vec2 getPos(uint32_t particle) const {
+			return glm::vec2(posX[particle], posY[particle]);
+		}
+
+		glm::vec2 getPrevPos(uint32_t particle) const {
+			return glm::vec2(prevX[particle], prevY[particle]);
+		}
+
+		// Closest movable particle within radius of pos | False if there is none
+		bool findParticle(glm::vec2 pos, float radius, uint32_t& found) const {
+			float best = radius * radius;
+			bool any = false;
+			for (uint32_t i = 0; i < used; ++i) {
+				float dx = posX[i] - pos.x, dy = posY[i] - pos.y;
+				if (invMass[i] > 0 && dx * dx + dy * dy <= best) {
+					best = dx * dx + dy * dy;
+					found = i;
+					any = true;
+				}
+			}
+			return any;
+		}
+
+		// Hangs a body on a particle | The body keeps its own motion and the rope holds it at length
+		void attach(BodyHandle body, uint32_t particle) {
+			attachments.push_back({ body, particle, invMass[particle] });
+		}
+
+		void detach(BodyHandle body) {
+			for (size_t a = 0; a < attachments.size(); ++a) {
+				if (attachments[a].body != body)
+					continue;
+				invMass[attachments[a].particle] = attachments[a].particleInvMass;
+				attachments.erase(attachments.begin() + a);
+				return;
+			}
+		}
+
+		// Runs after world.step | Hanging bodies move into their particles, the rope is solved and they take the result back
+		void step(World& world, float dt) {
+			if (ropes.empty())
+				return;
+			integrate(dt, gravity);
+
+			for (const Attachment& a : attachments) {
+				glm::vec2 pos = world.getPos(a.body), velocity = world.getVelocity(a.body);
+				posX[a.particle] = pos.x;
+				posY[a.particle] = pos.y;
+				prevX[a.particle] = pos.x - velocity.x * dt;
+				prevY[a.particle] = pos.y - velocity.y * dt;
+				invMass[a.particle] = toFloat(world.invMass[world.index(a.body)]);
+			}
+
+			updateWeights();
+			for (int iteration = 0; iteration < iterations; ++iteration) {
+				solvePass(evenWeight);
+				solvePass(oddWeight);
+				for (const Rope& rope : ropes) {
+					if (rope.pinStart)
+						tether(rope, rope.first, reachStart);
+					if (rope.pinEnd)
+						tether(rope, rope.first + rope.count - 1, reachEnd);
+				}
+			}
+			collideTiles();
+
+			// Bodies are swept to their particle, so a rope swinging into a wall can't drag them into it | The particle stays where its body stopped
+			for (const Attachment& a : attachments) {
+				uint32_t i = world.index(a.body);
+				SweepResult moved = sweepBox(*map, world.posX[i], world.posY[i], world.halfW[i], world.halfH[i], toReal(posX[a.particle]) - world.posX[i], toReal(posY[a.particle]) - world.posY[i]);
+				glm::vec2 pos(toFloat(moved.x), toFloat(moved.y));
+				posX[a.particle] = pos.x;
+				posY[a.particle] = pos.y;
+				world.setPosition(a.body, pos);
+				world.setVelocity(a.body, (pos - getPrevPos(a.particle)) / dt);
+			}
+		}
+
+		// Particle state and attachments | The layout of the ropes is not saved, so restore only into a system with the same ropes
+		void save(StateBuffer& buffer) const {
+			buffer.writeArray(posX);
+			buffer.writeArray(posY);
+			buffer.writeArray(prevX);
+			buffer.writeArray(prevY);
+			buffer.writeArray(invMass);
+			buffer.writeArray(attachments);
+		}
+
+		void restore(StateBuffer& buffer) {
+			buffer.readArray(posX);
+			buffer.readArray(posY);
+			buffer.readArray(prevX);
+			buffer.readArray(prevY);
+			buffer.readArray(invMass);
+			buffer.readArray(attachments);
+		}
+	};
+
+	// Rope of gameMap::buildDemoLevel, hanging over the floor's right half | Replays hang it too, so recorded grabs find it
+	inline void hangDemoRopes(RopeSystem& ropes) {
+		ropes.addRope(glm::vec2(11.0f, 8.8f), glm::vec2(11.0f, 4.6f), 14, true);
+	}
+
+	// Draws every rope as a line strip through its particles, interpolated between the last two ticks like the sprites
+	class RopeRenderer {
+	private:
+		renderUtil::ShaderEngine shader;
+		GLuint vao = 0, buffer = 0;
+		size_t bufferSize = 0;
+		// Upload scratch | Indexed like the particles, padding included, so every rope is one range of it
+		std::vector<glm::vec2> points;
+	public:
+		glm::vec4 color = ROPE_COLOR;
+
+		RopeRenderer(const std::string& vertexPath = "rope.vert", const std::string& fragmentPath = "rope.frag")
+			: shader(vertexPath, fragmentPath) {
+			glGenVertexArrays(1, &vao);
+			glBindVertexArray(vao);
+
+				glGenBuffers(1, &buffer);
+				glBindBuffer(GL_ARRAY_BUFFER, buffer);
+				glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void*)0);
+				glEnableVertexAttribArray(0);
+
+			glBindVertexArray(0);
+		}
+
+		~RopeRenderer() {
+			glDeleteBuffers(1, &buffer);
+			glDeleteVertexArrays(1, &vao);
+		}
+
+		// alpha is the tick fraction the sprites are drawn at
+		void draw(const RopeSystem& ropes, const glm::mat4& projection, const glm::mat4& view, float alpha) {
+			if (ropes.ropeCount() == 0)
+				return;
+
+			points.resize(ropes.particleCount());
+			for (uint32_t r = 0; r < ropes.ropeCount(); ++r) {
+				for (uint32_t k = 0; k < ropes.ropeSize(r); ++k) {
+					uint32_t i = ropes.particle(r, k);
+					points[i] = glm::mix(ropes.getPrevPos(i), ropes.getPos(i), alpha);
+				}
+			}
+
+			glBindBuffer(GL_ARRAY_BUFFER, buffer);
+			size_t bytes = points.size() * sizeof(glm::vec2);
+			// Orphans last frame's storage, so the upload doesn't wait for draws still reading it
+			bufferSize = std::max(bufferSize, bytes);
+			glBufferData(GL_ARRAY_BUFFER, bufferSize, nullptr, GL_STREAM_DRAW);
+			glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, points.data());
+
+			shader.use();
+			shader.setMat4("projection", projection);
+			shader.setMat4("view", view);
+			shader.setVec4("color", color);
+			glBindVertexArray(vao);
+			for (uint32_t r = 0; r < ropes.ropeCount(); ++r)
+				glDrawArrays(GL_LINE_STRIP, ropes.particle(r, 0), ropes.ropeSize(r));
+			glBindVertexArray(0);
+		}
+	};
+}
\ No newline at end of file
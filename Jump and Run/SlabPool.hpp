@@ -0,0 +1,132 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+
+namespace memory {
+
+	// Slot in the low 20 bits, generation in the high 12 | Same layout as body, projectile and entity handles
+	typedef uint32_t Handle;
+	const Handle NO_HANDLE = 0xFFFFFFFF;
+
+	// Objects of one type in fixed sized slabs, referenced by generational handles instead of pointers
+	// Live objects occupy the dense indices [0, size()), destroying one moves the last into the gap, so create and destroy are O(1)
+	// A handle whose object was destroyed never resolves again, even after its slot is reused
+	// Slabs are allocated SLAB_SIZE objects at a time and never freed or moved, so a reserved pool allocates nothing
+	template<typename T, size_t SLAB_SIZE = 256>
+	class SlabPool {
+	private:
+		static const uint32_t SLOT_BITS = 20;
+		static const uint32_t SLOT_MASK = (1 << SLOT_BITS) - 1;
+
+		std::vector<std::unique_ptr<T[]>> slabs;
+		size_t count = 0;
+
+		// Slot -> dense index | Slots stay put while dense indices move on destroy
+		std::vector<uint32_t> slotIndex;
+		std::vector<uint32_t> slotGeneration;
+		std::vector<uint32_t> freeSlots;
+		// Dense index -> slot
+		std::vector<uint32_t> denseSlot;
+
+		static Handle makeHandle(uint32_t slot, uint32_t generation) {
+			return (generation << SLOT_BITS) | slot;
+		}
+	public:
+		size_t size() const {
+			return count;
+		}
+
+		// Objects the allocated slabs hold
+		size_t capacity() const {
+			return slabs.size() * SLAB_SIZE;
+		}
+
+		void reserve(size_t objects) {
+			while (capacity() < objects)
+				slabs.emplace_back(new T[SLAB_SIZE]);
+			slotIndex.reserve(objects);
+			slotGeneration.reserve(objects);
+			freeSlots.reserve(objects);
+			denseSlot.reserve(objects);
+		}
+
+		Handle create(const T& value = T()) {
+			if (count == capacity())
+				slabs.emplace_back(new T[SLAB_SIZE]);
+			uint32_t slot;
+			if (freeSlots.empty()) {
+				slot = static_cast<uint32_t>(slotIndex.size());
+				slotIndex.push_back(0);
+				slotGeneration.push_back(0);
+			}
+			else {
+				slot = freeSlots.back();
+				freeSlots.pop_back();
+			}
+			slotIndex[slot] = static_cast<uint32_t>(count);
+			denseSlot.push_back(slot);
+			at(count++) = value;
+			return makeHandle(slot, slotGeneration[slot]);
+		}
+
+		// Stale handles are ignored
+		void destroy(Handle handle) {
+			if (!valid(handle))
+				return;
+			uint32_t slot = handle & SLOT_MASK;
+			uint32_t i = slotIndex[slot];
+			uint32_t last = static_cast<uint32_t>(--count);
+			if (i != last) {
+				at(i) = at(last);
+				denseSlot[i] = denseSlot[last];
+				slotIndex[denseSlot[i]] = i;
+			}
+			denseSlot.pop_back();
+			slotGeneration[slot] = (slotGeneration[slot] + 1) & (0xFFFFFFFF >> SLOT_BITS);
+			freeSlots.push_back(slot);
+		}
+
+		bool valid(Handle handle) const {
+			uint32_t slot = handle & SLOT_MASK;
+			return handle != NO_HANDLE && slot < slotIndex.size() && slotGeneration[slot] == (handle >> SLOT_BITS);
+		}
+
+		// nullptr for stale handles | Only valid until the next destroy
+		T* get(Handle handle) {
+			return valid(handle) ? &at(slotIndex[handle & SLOT_MASK]) : nullptr;
+		}
+
+		const T* get(Handle handle) const {
+			return valid(handle) ? &at(slotIndex[handle & SLOT_MASK]) : nullptr;
+		}
+
+		// Object at a dense index
+		T& at(size_t i) {
+			return slabs[i / SLAB_SIZE][i % SLAB_SIZE];
+		}
+
+		const T& at(size_t i) const {
+			return slabs[i / SLAB_SIZE][i % SLAB_SIZE];
+		}
+
+		// Handle of the object at a dense index
+		Handle handle(size_t i) const {
+			return makeHandle(denseSlot[i], slotGeneration[denseSlot[i]]);
+		}
+
+		// Calls func(handle, object) for every live object, one slab after another
+		template<typename F>
+		void each(F func) {
+			for (size_t s = 0; s * SLAB_SIZE < count; ++s) {
+				T* slab = slabs[s].get();
+				size_t end = std::min(SLAB_SIZE, count - s * SLAB_SIZE);
+				for (size_t k = 0; k < end; ++k)
+					func(handle(s * SLAB_SIZE + k), slab[k]);
+			}
+		}
+	};
+}
\ No newline at end of file
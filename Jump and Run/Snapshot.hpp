@@ -0,0 +1,105 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "Map.hpp"
+#include "Physics.hpp"
+#include "StateBuffer.hpp"
+
+
+namespace physics {
+
+	// Ring of the last saved frames of the whole simulation | For rollback, rewinding and replay seeking
+	// Bodies, entities and handler state are copied whole, the map only as the cells changed between two frames
+	// Frame buffers are kept across laps, so once the ring went around once saving allocates nothing
+	class SnapshotRing {
+	private:
+		struct Frame {
+			uint64_t tick = 0;
+			StateBuffer state;
+			// Cells changed since the previous frame
+			std::vector<gameMap::CellChange> mapChanges;
+			// Edited cells the physics had not woken bodies around yet
+			std::vector<glm::uvec2> mapEdits;
+		};
+
+		PhysicsHandler* physics;
+		gameMap::Map* map;
+		std::vector<Frame> frames;
+		// Ring position of the oldest frame and number of frames held
+		size_t first = 0, count = 0;
+
+		Frame& at(size_t i) {
+			return frames[(first + i) % frames.size()];
+		}
+
+		const Frame& at(size_t i) const {
+			return frames[(first + i) % frames.size()];
+		}
+	public:
+		// capacity frames of bytesPerFrame each are allocated up front | Frames grow on their own if the state outgrows them
+		SnapshotRing(PhysicsHandler* physics, gameMap::Map* map, size_t capacity, size_t bytesPerFrame = 0)
+			: physics(physics), map(map), frames(capacity) {
+			map->logChanges(true);
+			for (Frame& f : frames)
+				f.state.reserve(bytesPerFrame);
+		}
+
+		~SnapshotRing() {
+			map->logChanges(false);
+		}
+
+		size_t size() const {
+			return count;
+		}
+
+		// Bytes the newest frame's state takes
+		size_t frameBytes() const {
+			return count > 0 ? at(count - 1).state.size() : 0;
+		}
+
+		bool has(uint64_t tick) const {
+			for (size_t i = 0; i < count; ++i) {
+				if (at(i).tick == tick)
+					return true;
+			}
+			return false;
+		}
+
+		// Saves the current state as the newest frame | Overwrites the oldest one once the ring is full
+		void save(uint64_t tick) {
+			if (count == frames.size()) {
+				first = (first + 1) % frames.size();
+				--count;
+			}
+			Frame& f = at(count++);
+			f.tick = tick;
+			f.state.clear();
+			physics->save(f.state);
+			map->takeChanges(f.mapChanges);
+			f.mapEdits.assign(map->getEdits().begin(), map->getEdits().end());
+		}
+
+		// Goes back to the frame saved for tick and forgets every newer one | False if the ring doesn't hold it
+		bool restore(uint64_t tick) {
+			size_t target = count;
+			for (size_t i = 0; i < count; ++i) {
+				if (at(i).tick == tick)
+					target = i;
+			}
+			if (target == count)
+				return false;
+
+			// Map changes are taken back newest first
+			map->undoPendingChanges();
+			for (size_t i = count - 1; i > target; --i)
+				map->undoChanges(at(i).mapChanges);
+			map->setEdits(at(target).mapEdits);
+
+			Frame& f = at(target);
+			f.state.rewind();
+			physics->restore(f.state);
+			count = target + 1;
+			return true;
+		}
+	};
+}
\ No newline at end of file
@@ -0,0 +1,95 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+
+
+namespace physics {
+
+	// Flat bytes a frame of simulation state is copied into | Every array goes in with a single memcpy
+	// Grows only while the state outgrows it, so a warmed up buffer never allocates
+	class StateBuffer {
+	private:
+		std::vector<unsigned char> bytes;
+		size_t used = 0, readAt = 0;
+
+		unsigned char* append(size_t count) {
+			if (used + count > bytes.size())
+				bytes.resize(std::max(used + count, bytes.size() * 2));
+			unsigned char* at = bytes.data() + used;
+			used += count;
+			return at;
+		}
+
+		const unsigned char* take(size_t count) {
+			const unsigned char* at = bytes.data() + readAt;
+			readAt += count;
+			return at;
+		}
+	public:
+		// Bytes written since the last clear
+		size_t size() const {
+			return used;
+		}
+
+		void reserve(size_t count) {
+			if (count > bytes.size())
+				bytes.resize(count);
+		}
+
+		// Starts a new frame | Keeps the memory
+		void clear() {
+			used = 0;
+			readAt = 0;
+		}
+
+		// Reads from the start again
+		void rewind() {
+			readAt = 0;
+		}
+
+		// T must be trivially copyable
+		template<typename T>
+		void write(const T& value) {
+			std::memcpy(append(sizeof(T)), &value, sizeof(T));
+		}
+
+		template<typename T>
+		void writeArray(const std::vector<T>& values) {
+			write(values.size());
+			if (!values.empty())
+				std::memcpy(append(values.size() * sizeof(T)), values.data(), values.size() * sizeof(T));
+		}
+
+		// First count values without a size | For fixed sized pools whose used part is saved separately
+		template<typename T>
+		void writeRange(const T* values, size_t count) {
+			if (count > 0)
+				std::memcpy(append(count * sizeof(T)), values, count * sizeof(T));
+		}
+
+		// Reads back in the order things were written
+		template<typename T>
+		void read(T& value) {
+			std::memcpy(&value, take(sizeof(T)), sizeof(T));
+		}
+
+		// Counterpart of writeRange | values must hold count elements
+		template<typename T>
+		void readRange(T* values, size_t count) {
+			if (count > 0)
+				std::memcpy(values, take(count * sizeof(T)), count * sizeof(T));
+		}
+
+		// Only allocates if the array never held that many elements
+		template<typename T>
+		void readArray(std::vector<T>& values) {
+			size_t count;
+			read(count);
+			values.resize(count);
+			if (count > 0)
+				std::memcpy(values.data(), take(count * sizeof(T)), count * sizeof(T));
+		}
+	};
+}
\ No newline at end of file
@@ -0,0 +1,90 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <string>
+#include <algorithm>
+#include <own/helper.hpp>
+
+
+namespace physics {
+
+	// Passes of World::step in the order they run
+	enum stepPhase {PHASE_WAKE, PHASE_INTEGRATE, PHASE_PAIRS, PHASE_TRIGGERS, PHASE_CONTACTS, PHASE_ISLANDS, PHASE_SOLVE, PHASE_TILES, PHASE_SLEEP, PHASE_DETAIL, PHASE_COUNT};
+	const char* const PHASE_NAMES[PHASE_COUNT] = {"wake", "integrate", "pairs", "triggers", "contacts", "islands", "solve", "tiles", "sleep", "detail"};
+
+	// What one step did and where its time went | Filled by World::step, a clock read per phase is all it costs
+	struct StepStats {
+		// Bodies the step moved
+		uint32_t integrated = 0;
+		// Cell lookups of the tile sweeps and contact probes
+		uint32_t cellsProbed = 0;
+		// Pairs the broadphase tested and the overlapping ones it reported
+		uint32_t candidates = 0;
+		uint32_t pairs = 0;
+		// Body pairs and tile faces findContacts tested
+		uint32_t narrowTests = 0;
+		uint32_t contacts = 0;
+		uint32_t islands = 0;
+		// Velocity and push iterations the solver ran | 0 without contacts
+		uint32_t solverIterations = 0;
+		float phaseMs[PHASE_COUNT] = {};
+		float totalMs = 0;
+	};
+
+	// Rolling average over the last ticks steps
+	class StatsAverage {
+	private:
+		std::vector<StepStats> history;
+		size_t next = 0;
+		size_t filled = 0;
+	public:
+		StatsAverage(size_t ticks = 60)
+			: history(ticks) {}
+
+		void add(const StepStats& stats) {
+			history[next] = stats;
+			next = (next + 1) % history.size();
+			filled = std::min(filled + 1, history.size());
+		}
+
+		StepStats average() const {
+			StepStats mean;
+			if (filled == 0)
+				return mean;
+			uint64_t counters[8] = {};
+			for (size_t k = 0; k < filled; ++k) {
+				const StepStats& s = history[k];
+				const uint32_t values[8] = { s.integrated, s.cellsProbed, s.candidates, s.pairs, s.narrowTests, s.contacts, s.islands, s.solverIterations };
+				for (int c = 0; c < 8; ++c)
+					counters[c] += values[c];
+				for (int p = 0; p < PHASE_COUNT; ++p)
+					mean.phaseMs[p] += s.phaseMs[p] / filled;
+				mean.totalMs += s.totalMs / filled;
+			}
+			uint32_t* out[8] = { &mean.integrated, &mean.cellsProbed, &mean.candidates, &mean.pairs, &mean.narrowTests, &mean.contacts, &mean.islands, &mean.solverIterations };
+			for (int c = 0; c < 8; ++c)
+				*out[c] = static_cast<uint32_t>(counters[c] / filled);
+			return mean;
+		}
+	};
+
+	// One line summary | Lists the slowest phases first
+	inline std::string describe(const StepStats& stats, int phases = 3) {
+		std::string text = "tick " + std::to_string(stats.totalMs) + " ms"
+			+ " | bodies " + std::to_string(stats.integrated)
+			+ " | cells " + std::to_string(stats.cellsProbed)
+			+ " | pairs " + std::to_string(stats.pairs) + "/" + std::to_string(stats.candidates)
+			+ " | tests " + std::to_string(stats.narrowTests)
+			+ " | contacts " + std::to_string(stats.contacts)
+			+ " | islands " + std::to_string(stats.islands)
+			+ " | iterations " + std::to_string(stats.solverIterations);
+
+		int order[PHASE_COUNT];
+		for (int p = 0; p < PHASE_COUNT; ++p)
+			order[p] = p;
+		std::stable_sort(order, order + PHASE_COUNT, [&](int a, int b) { return stats.phaseMs[a] > stats.phaseMs[b]; });
+		for (int k = 0; k < std::min(phases, static_cast<int>(PHASE_COUNT)); ++k)
+			text += std::string(" | ") + PHASE_NAMES[order[k]] + " " + std::to_string(stats.phaseMs[order[k]]) + " ms";
+		return text;
+	}
+}
\ No newline at end of file
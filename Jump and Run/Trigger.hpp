@@ -0,0 +1,183 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include "Fixed.hpp"
+#include "StateBuffer.hpp"
+
+
+namespace physics {
+
+	// Generation in the high and index in the low TRIGGER_BITS | The index is reused after the trigger's exit events went out, the generation tells the reuses apart
+	typedef uint32_t TriggerHandle;
+	const uint32_t TRIGGER_BITS = 20;
+	const uint32_t TRIGGER_MASK = (1 << TRIGGER_BITS) - 1;
+	const size_t DEFAULT_EVENT_CAPACITY = 1024;
+
+	enum triggerEventType : uint8_t {TRIGGER_ENTER, TRIGGER_STAY, TRIGGER_EXIT};
+
+	struct TriggerEvent {
+		TriggerHandle trigger;
+		// BodyHandle of the body | May already be removed for exit events
+		uint32_t body;
+		// Set by the game when adding the trigger | Tells checkpoints, pickups and exits apart without a lookup
+		uint32_t tag;
+		triggerEventType type;
+	};
+
+	// Static boxes that report bodies entering, staying in and leaving them
+	// Overlaps are collected during the step and diffed against the last step's, the events land in a buffer
+	// whose capacity is fixed up front | Events past it are counted in dropped instead of growing the buffer
+	class TriggerSet {
+	private:
+		struct Trigger {
+			glm::vec2 min, max;
+			real minX, minY, maxX, maxY;
+			uint32_t tag;
+			bool active, removed;
+			// Bumped when the index is released
+			uint32_t generation;
+		};
+
+		std::vector<Trigger> triggers;
+		std::vector<uint32_t> freeTriggers;
+
+		// Trigger in the high and body in the low 32 bits | Sorted so the diff is a single merge
+		std::vector<uint64_t> overlaps, lastOverlaps;
+		std::vector<TriggerEvent> events;
+		size_t capacity;
+
+		void emit(uint64_t overlap, triggerEventType type) {
+			if (events.size() == capacity) {
+				++dropped;
+				return;
+			}
+			uint32_t t = static_cast<uint32_t>(overlap >> 32);
+			events.push_back({ handle(t), static_cast<uint32_t>(overlap), triggers[t].tag, type });
+		}
+	public:
+		// Events that didn't fit into the buffer during the last step
+		size_t dropped = 0;
+
+		TriggerSet(size_t eventCapacity = DEFAULT_EVENT_CAPACITY)
+			: capacity(eventCapacity) {
+			events.reserve(capacity);
+			overlaps.reserve(capacity);
+			lastOverlaps.reserve(capacity);
+		}
+
+		TriggerHandle add(glm::vec2 min, glm::vec2 max, uint32_t tag) {
+			Trigger t = { min, max, toReal(min.x), toReal(min.y), toReal(max.x), toReal(max.y), tag, true, false, 0 };
+			if (freeTriggers.empty()) {
+				triggers.push_back(t);
+				return handle(static_cast<uint32_t>(triggers.size()) - 1);
+			}
+			uint32_t index = freeTriggers.back();
+			freeTriggers.pop_back();
+			t.generation = triggers[index].generation;
+			triggers[index] = t;
+			return handle(index);
+		}
+
+		// Bodies inside get their exit events with the next step | Removing a trigger twice or after its index was reused does nothing
+		void remove(TriggerHandle trigger) {
+			if (!isValid(trigger))
+				return;
+			Trigger& t = triggers[trigger & TRIGGER_MASK];
+			t.active = false;
+			t.removed = true;
+		}
+
+		// Added and not removed yet
+		bool isValid(TriggerHandle trigger) const {
+			uint32_t index = trigger & TRIGGER_MASK;
+			return index < triggers.size() && triggers[index].generation == trigger >> TRIGGER_BITS && !triggers[index].removed;
+		}
+
+		// Indices handed out so far | handle turns one into the handle of whatever trigger holds it now
+		size_t size() const {
+			return triggers.size();
+		}
+
+		TriggerHandle handle(uint32_t index) const {
+			return (triggers[index].generation << TRIGGER_BITS) | index;
+		}
+
+		bool isActive(TriggerHandle trigger) const {
+			return triggers[trigger & TRIGGER_MASK].active;
+		}
+
+		glm::vec2 getMin(TriggerHandle trigger) const {
+			return triggers[trigger & TRIGGER_MASK].min;
+		}
+
+		glm::vec2 getMax(TriggerHandle trigger) const {
+			return triggers[trigger & TRIGGER_MASK].max;
+		}
+
+		// Exact test against a body box given by center and half extents
+		bool contains(TriggerHandle trigger, real x, real y, real halfW, real halfH) const {
+			const Trigger& t = triggers[trigger & TRIGGER_MASK];
+			return x - halfW < t.maxX && t.minX < x + halfW && y - halfH < t.maxY && t.minY < y + halfH;
+		}
+
+		// Starts collecting the overlaps of a new step
+		void begin() {
+			overlaps.swap(lastOverlaps);
+			overlaps.clear();
+			events.clear();
+			dropped = 0;
+		}
+
+		void overlap(TriggerHandle trigger, uint32_t body) {
+			overlaps.push_back(uint64_t(trigger & TRIGGER_MASK) << 32 | body);
+		}
+
+		// Turns the difference to the last step into events and releases removed triggers
+		void end() {
+			std::sort(overlaps.begin(), overlaps.end());
+			size_t a = 0, b = 0;
+			while (a < lastOverlaps.size() || b < overlaps.size()) {
+				if (b == overlaps.size() || (a < lastOverlaps.size() && lastOverlaps[a] < overlaps[b]))
+					emit(lastOverlaps[a++], TRIGGER_EXIT);
+				else if (a == lastOverlaps.size() || overlaps[b] < lastOverlaps[a])
+					emit(overlaps[b++], TRIGGER_ENTER);
+				else {
+					emit(overlaps[b++], TRIGGER_STAY);
+					++a;
+				}
+			}
+
+			for (uint32_t t = 0; t < triggers.size(); ++t) {
+				if (triggers[t].removed) {
+					triggers[t].removed = false;
+					triggers[t].generation = (triggers[t].generation + 1) & (0xFFFFFFFF >> TRIGGER_BITS);
+					freeTriggers.push_back(t);
+				}
+			}
+		}
+
+		// Events of the last step in trigger order, then body order
+		const std::vector<TriggerEvent>& getEvents() const {
+			return events;
+		}
+
+		// The last step's overlaps are all the next diff needs
+		void save(StateBuffer& buffer) const {
+			buffer.writeArray(triggers);
+			buffer.writeArray(freeTriggers);
+			buffer.writeArray(overlaps);
+			buffer.writeArray(events);
+			buffer.write(dropped);
+		}
+
+		void restore(StateBuffer& buffer) {
+			buffer.readArray(triggers);
+			buffer.readArray(freeTriggers);
+			buffer.readArray(overlaps);
+			buffer.readArray(events);
+			buffer.read(dropped);
+		}
+	};
+}
\ No newline at end of file
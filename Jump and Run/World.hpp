@@ -0,0 +1,1124 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <memory>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include "Map.hpp"
+#include "Fixed.hpp"
+#include "Collision.hpp"
+#include "Broadphase.hpp"
+#include "Trigger.hpp"
+#include "Jobs.hpp"
+#include "Events.hpp"
+#include "StateBuffer.hpp"
+#include "Stats.hpp"
+
+
+namespace physics {
+
+	// Stable reference to a body | Low 20 bits are the slot, high 12 bits its generation
+	typedef uint32_t BodyHandle;
+	const BodyHandle INVALID_BODY = 0xFFFFFFFF;
+
+	enum bodyFlags : uint8_t {
+		BODY_ON_GROUND = 1 << 0,
+		BODY_HIT_WALL = 1 << 1,
+		BODY_HIT_CEILING = 1 << 2
+	};
+
+	// Units per second squared | Shared by the World, the ropes and the headless environments
+	const glm::vec2 DEFAULT_GRAVITY(0.0f, -36.0f);
+
+	// Distance at which touching bodies and tiles already produce contacts
+	const real CONTACT_MARGIN = toReal(0.05f);
+	// Penetration left alone to keep resting contacts from jittering
+	const real CONTACT_SLOP = toReal(0.005f);
+	// Fraction of the penetration corrected per tick | Applied as a separate push that never turns into velocity
+	const real BAUMGARTE = toReal(0.2f);
+	// Default solver iterations | Warm started contacts need far fewer than cold ones
+	const int SOLVER_ITERATIONS = 8;
+	// Bodies per task in the integrate, tile and contact passes
+	const size_t BODY_BATCH = 256;
+
+	// Bodies slower than this (units per second) for TIME_TO_SLEEP seconds fall asleep with their island
+	const real SLEEP_VELOCITY = toReal(0.05f);
+	const real TIME_TO_SLEEP = toReal(0.5f);
+
+	const uint32_t TILE_CONTACT = 0xFFFFFFFF;
+	const uint32_t NO_ISLAND = 0xFFFFFFFF;
+	// Ends the slot chain of a sleeping island
+	const uint32_t NO_SLOT = 0xFFFFFFFF;
+	// Island of frozen bodies | They sit in the sleeping range but belong to no island and keep their velocity
+	const uint32_t FROZEN_ISLAND = 0xFFFFFFFE;
+	// Set in contact keys of tile contacts | Body pair keys never reach it since slots only use 20 bits
+	const uint64_t TILE_FEATURE = 0x80000000;
+	// Marks free entries of the impulse cache | No contact key gets there
+	const uint64_t NO_CONTACT = 0xFFFFFFFFFFFFFFFF;
+
+	// Published on the world's event bus when a body comes down on a tile after a step without ground
+	struct LandingEvent {
+		BodyHandle body;
+		// Downward speed at the moment of landing
+		float speed;
+	};
+
+	// Touching pair of bodies or a body and the tile grid | Valid for one step
+	struct Contact {
+		// Dense indices | b is TILE_CONTACT for tiles
+		uint32_t a, b;
+		// Same for the same pair of slots and contact axis, or the same slot and tile face, across ticks
+		uint64_t key;
+		// Axis aligned unit vector from a to b
+		real normalX, normalY;
+		// Negative while penetrating
+		real separation;
+		real mass;
+		// Accumulated normal impulse | Starts at last tick's value when warm starting
+		real impulse;
+		// Accumulated impulse of the penetration push | Starts at zero every step
+		real pushImpulse;
+	};
+
+	// Update tiers by distance from the view | Distances run from the view rectangle to the body center, along the farther axis
+	struct DetailSettings {
+		// Beyond it bodies run at the reduced rate | Keeps their coarser motion off screen
+		float fullDistance = 4.0f;
+		// Beyond it bodies are frozen
+		float freezeDistance = 32.0f;
+		// Reduced rate bodies are stepped every reducedInterval ticks, by that many ticks at once
+		int reducedInterval = 4;
+	};
+
+	// Bodies come back a tier only this far inside its border | Stops bodies on a border from switching every time
+	const float DETAIL_HYSTERESIS = 1.0f;
+
+	// Impulse a contact ended the last step with
+	struct CachedImpulse {
+		uint64_t key;
+		real impulse;
+	};
+
+	// Owns all dynamic bodies in structure-of-arrays form
+	// Awake bodies occupy the dense indices [0, awakeCount), sleeping bodies the rest, so the per tick passes only touch awake ones
+	// With a view set the awake range splits into full rate bodies [0, fullCount) and reduced rate ones [fullCount, awakeCount)
+	class World {
+	private:
+		static const uint32_t SLOT_BITS = 20;
+		static const uint32_t SLOT_MASK = (1 << SLOT_BITS) - 1;
+
+		gameMap::Map* map;
+
+		// Slot -> dense index | Slots stay put while dense indices move on removal
+		std::vector<uint32_t> slotIndex;
+		std::vector<uint32_t> slotGeneration;
+		std::vector<uint32_t> freeSlots;
+		// Dense index -> slot
+		std::vector<uint32_t> denseSlot;
+
+		std::unique_ptr<Broadphase> broadphase;
+		TriggerSet triggers;
+
+		size_t awakeCount = 0;
+		size_t fullCount = 0;
+		size_t frozenCount = 0;
+		uint32_t sleepVersion = 0;
+		uint32_t parkedVersion = 0;
+
+		// Level of detail | Reduced rate bodies only take part in wide ticks, every detail.reducedInterval ticks
+		bool viewSet = false;
+		glm::vec2 viewMin, viewMax;
+		uint64_t tickCount = 0;
+		bool wideTick = true;
+
+		// Bodies that fell asleep together, chained through their slots | Touching one wakes all of them
+		// Flat arrays only, so the whole world state copies out with a handful of memcpys
+		std::vector<uint32_t> islandFirst, islandLast;
+		// Slot -> next slot of the same island | NO_SLOT ends the chain
+		std::vector<uint32_t> islandNext;
+		std::vector<uint32_t> freeIslands;
+		// Slot -> whether a body uses it | Scratch for restore
+		std::vector<uint8_t> slotUsed;
+
+		// Scratch buffers reused every step
+		std::vector<uint32_t> islandParent;
+		std::vector<real> islandSleepTime;
+		std::vector<uint32_t> islandOfRoot;
+		std::vector<uint32_t> toWake;
+		std::vector<BodyHandle> toMove;
+		std::vector<uint32_t> queryResult;
+		std::vector<std::vector<Contact>> batchContacts;
+		// Cells probed per batch | Summed in batch order so the count doesn't depend on the threads
+		std::vector<uint32_t> batchProbes;
+		util::chrono::point phaseStart;
+
+		// Contacts grouped by island | Island k owns islandContacts[islandStart[k], islandStart[k + 1])
+		std::vector<uint32_t> rootIsland;
+		std::vector<uint32_t> islandStart;
+		std::vector<uint32_t> islandContacts;
+		std::vector<uint32_t> islandFill;
+
+		// Open addressing table of last step's non-zero impulses | Capacity is a power of two, at least twice the entries
+		std::vector<CachedImpulse> impulseCache;
+		size_t impulseMask = 0;
+		// Velocity that only moves awake bodies out of each other this step | Written by the solver, used by collideTiles
+		std::vector<real> pushX, pushY;
+
+		jobs::WorkerPool* pool = nullptr;
+		events::EventBus* bus = nullptr;
+
+		static BodyHandle makeHandle(uint32_t slot, uint32_t generation) {
+			return (generation << SLOT_BITS) | slot;
+		}
+
+		void swapBodies(uint32_t i, uint32_t j) {
+			if (i == j)
+				return;
+			std::swap(posX[i], posX[j]); std::swap(posY[i], posY[j]);
+			std::swap(prevX[i], prevX[j]); std::swap(prevY[i], prevY[j]);
+			std::swap(velX[i], velX[j]); std::swap(velY[i], velY[j]);
+			std::swap(halfW[i], halfW[j]); std::swap(halfH[i], halfH[j]);
+			std::swap(invMass[i], invMass[j]);
+			std::swap(sleepTime[i], sleepTime[j]);
+			std::swap(island[i], island[j]);
+			std::swap(flags[i], flags[j]);
+			std::swap(denseSlot[i], denseSlot[j]);
+			slotIndex[denseSlot[i]] = i;
+			slotIndex[denseSlot[j]] = j;
+		}
+
+		void popBody() {
+			posX.pop_back(); posY.pop_back(); prevX.pop_back(); prevY.pop_back();
+			velX.pop_back(); velY.pop_back();
+			halfW.pop_back(); halfH.pop_back();
+			invMass.pop_back();
+			sleepTime.pop_back();
+			island.pop_back();
+			flags.pop_back();
+			denseSlot.pop_back();
+		}
+
+		// Moves a sleeping or frozen body to the end of the full rate range
+		void moveAwake(uint32_t i) {
+			if (i < awakeCount)
+				return;
+			if (island[i] == FROZEN_ISLAND)
+				--frozenCount;
+			island[i] = NO_ISLAND;
+			sleepTime[i] = real(0);
+			swapBodies(i, static_cast<uint32_t>(awakeCount));
+			swapBodies(static_cast<uint32_t>(awakeCount), static_cast<uint32_t>(fullCount));
+			++awakeCount;
+			++fullCount;
+		}
+
+		// Moves an awake body of either rate to the front of the sleeping range
+		void leaveAwakeRange(uint32_t i) {
+			if (i < fullCount) {
+				--fullCount;
+				swapBodies(i, static_cast<uint32_t>(fullCount));
+				i = static_cast<uint32_t>(fullCount);
+			}
+			--awakeCount;
+			swapBodies(i, static_cast<uint32_t>(awakeCount));
+		}
+
+		// Stops the body and files it under its sleeping island
+		void moveAsleep(uint32_t i, uint32_t islandId) {
+			velX[i] = 0;
+			velY[i] = 0;
+			island[i] = islandId;
+			leaveAwakeRange(i);
+		}
+
+		// Keeps the velocity so the body carries on where it stopped once thawed
+		void freeze(uint32_t i) {
+			prevX[i] = posX[i];
+			prevY[i] = posY[i];
+			island[i] = FROZEN_ISLAND;
+			++frozenCount;
+			leaveAwakeRange(i);
+		}
+
+		// Bodies stepped this tick | The reduced rate ones only join on wide ticks
+		size_t activeCount() const {
+			return wideTick ? awakeCount : fullCount;
+		}
+
+		// Step length of the body at dense index i during a wide tick
+		real stepTime(uint32_t i, real dt) const {
+			return i < fullCount ? dt : dt * real(detail.reducedInterval);
+		}
+
+		// Contacts with a reduced rate body use its longer step | Closing the gap or pushing out then takes longer, never overshoots
+		real contactStepTime(const Contact& c, real dt) const {
+			bool reduced = c.a >= fullCount || (c.b < activeCount() && c.b >= fullCount);
+			return reduced ? dt * real(detail.reducedInterval) : dt;
+		}
+
+		// Distance from the view rectangle along the farther axis | Negative inside the view
+		float viewDistance(uint32_t i) const {
+			float x = toFloat(posX[i]), y = toFloat(posY[i]);
+			return std::max(std::max(viewMin.x - x, x - viewMax.x), std::max(viewMin.y - y, y - viewMax.y));
+		}
+
+		uint32_t findRoot(uint32_t i) {
+			while (islandParent[i] != i) {
+				islandParent[i] = islandParent[islandParent[i]];
+				i = islandParent[i];
+			}
+			return i;
+		}
+
+		uint32_t allocateIsland() {
+			if (freeIslands.empty()) {
+				islandFirst.push_back(NO_SLOT);
+				islandLast.push_back(NO_SLOT);
+				return static_cast<uint32_t>(islandFirst.size()) - 1;
+			}
+			uint32_t id = freeIslands.back();
+			freeIslands.pop_back();
+			return id;
+		}
+
+		void appendToIsland(uint32_t id, uint32_t slot) {
+			islandNext[slot] = NO_SLOT;
+			if (islandLast[id] == NO_SLOT)
+				islandFirst[id] = slot;
+			else
+				islandNext[islandLast[id]] = slot;
+			islandLast[id] = slot;
+		}
+
+		// Unlinks a removed sleeping body | Frees the island once its last body is gone
+		void removeFromIsland(uint32_t id, uint32_t slot) {
+			uint32_t before = NO_SLOT;
+			for (uint32_t s = islandFirst[id]; s != slot; s = islandNext[s])
+				before = s;
+			if (before == NO_SLOT)
+				islandFirst[id] = islandNext[slot];
+			else
+				islandNext[before] = islandNext[slot];
+			if (islandLast[id] == slot)
+				islandLast[id] = before;
+			if (islandFirst[id] == NO_SLOT)
+				freeIslands.push_back(id);
+		}
+
+		void wakeIsland(uint32_t id) {
+			// Frozen bodies only thaw once the view comes close or through wake
+			if (id == FROZEN_ISLAND)
+				return;
+			for (uint32_t slot = islandFirst[id]; slot != NO_SLOT; slot = islandNext[slot])
+				moveAwake(slotIndex[slot]);
+			islandFirst[id] = islandLast[id] = NO_SLOT;
+			freeIslands.push_back(id);
+		}
+
+		void addContact(std::vector<Contact>& to, uint32_t a, uint32_t b, int axis, int dir, real separation) {
+			real invSum = invMass[a] + (b < activeCount() ? invMass[b] : real(0));
+			if (invSum <= real(0))
+				return;
+			real normalX = axis == 0 ? real(dir) : real(0);
+			real normalY = axis == 1 ? real(dir) : real(0);
+
+			uint64_t key;
+			if (b == TILE_CONTACT)
+				key = (uint64_t(denseSlot[a]) << 32) | TILE_FEATURE | uint64_t(axis << 1 | (dir > 0));
+			else
+				key = (uint64_t(std::min(denseSlot[a], denseSlot[b])) << 32) | uint64_t(std::max(denseSlot[a], denseSlot[b])) << 1 | uint64_t(axis);
+			to.push_back({ a, b, key, normalX, normalY, separation, real(1) / invSum, real(0), real(0) });
+		}
+
+		static size_t hashKey(uint64_t key) {
+			return static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> 32);
+		}
+
+		real cachedImpulse(uint64_t key) const {
+			if (impulseCache.empty())
+				return real(0);
+			for (size_t i = hashKey(key) & impulseMask;; i = (i + 1) & impulseMask) {
+				if (impulseCache[i].key == key)
+					return impulseCache[i].impulse;
+				if (impulseCache[i].key == NO_CONTACT)
+					return real(0);
+			}
+		}
+
+		void cacheImpulses() {
+			// Sized by the impulses kept rather than all contacts | Keeps the table small enough to snapshot cheaply
+			size_t kept = 0;
+			for (const Contact& c : contacts)
+				kept += c.impulse != real(0);
+			size_t capacity = 16;
+			while (capacity < kept * 2)
+				capacity *= 2;
+			impulseCache.assign(capacity, { NO_CONTACT, real(0) });
+			impulseMask = capacity - 1;
+			for (const Contact& c : contacts) {
+				if (c.impulse == real(0))
+					continue;
+				size_t i = hashKey(c.key) & impulseMask;
+				while (impulseCache[i].key != NO_CONTACT)
+					i = (i + 1) & impulseMask;
+				impulseCache[i] = { c.key, c.impulse };
+			}
+		}
+
+		void applyImpulse(const Contact& c, real impulse, std::vector<real>& x, std::vector<real>& y) {
+			x[c.a] -= impulse * invMass[c.a] * c.normalX;
+			y[c.a] -= impulse * invMass[c.a] * c.normalY;
+			if (c.b < activeCount()) {
+				x[c.b] += impulse * invMass[c.b] * c.normalX;
+				y[c.b] += impulse * invMass[c.b] * c.normalY;
+			}
+		}
+
+		// One sequential impulse pass on either the velocities or the pushes | Clamps the accumulated sum
+		// so later iterations can take back what earlier ones overshot
+		void solveNormal(Contact& c, real target, real& accumulated, std::vector<real>& x, std::vector<real>& y) {
+			bool moveB = c.b < activeCount();
+			real vbx = moveB ? x[c.b] : real(0), vby = moveB ? y[c.b] : real(0);
+			real vn = (vbx - x[c.a]) * c.normalX + (vby - y[c.a]) * c.normalY;
+
+			real total = std::max(accumulated + (target - vn) * c.mass, real(0));
+			real impulse = total - accumulated;
+			accumulated = total;
+			if (impulse != real(0))
+				applyImpulse(c, impulse, x, y);
+		}
+
+		// Stores the time since the last phase ended as the time of phase
+		void endPhase(stepPhase phase) {
+			util::chrono::point now = util::chrono::now();
+			stats.phaseMs[phase] = util::chrono::deltaTime(phaseStart, now) * 1000;
+			phaseStart = now;
+		}
+
+		// Adds the cells the batches probed to the stats
+		void sumProbes(size_t batches) {
+			for (size_t b = 0; b < batches; ++b)
+				stats.cellsProbed += batchProbes[b];
+		}
+
+		// Runs func(begin, end) over batches of [0, count), on the worker pool if there is one
+		template<typename F>
+		void forBatches(size_t count, F func) {
+			if (pool) {
+				pool->parallelFor(count, BODY_BATCH, func);
+				return;
+			}
+			for (size_t begin = 0; begin < count; begin += BODY_BATCH)
+				func(begin, std::min(count, begin + BODY_BATCH));
+		}
+
+	public:
+		// Dense body data | Index i of every array belongs to the same body
+		std::vector<real> posX, posY, prevX, prevY;
+		std::vector<real> velX, velY;
+		std::vector<real> halfW, halfH;
+		std::vector<real> invMass;
+		// Seconds spent below SLEEP_VELOCITY
+		std::vector<real> sleepTime;
+		// Sleeping island of the body | NO_ISLAND while awake
+		std::vector<uint32_t> island;
+		std::vector<uint8_t> flags;
+
+		// Overlapping body pairs and contacts of the last step
+		std::vector<BodyPair> pairs;
+		std::vector<Contact> contacts;
+		// Counters and phase times of the last step
+		StepStats stats;
+
+		// Units per second squared
+		glm::vec2 gravity = DEFAULT_GRAVITY;
+
+		int solverIterations = SOLVER_ITERATIONS;
+		// Start each contact from the impulse it ended the last step with
+		bool warmStarting = true;
+		// Tier distances and rate | Only used once a view is set
+		DetailSettings detail;
+
+		World(gameMap::Map* map, std::unique_ptr<Broadphase> broadphase = std::unique_ptr<Broadphase>(new SpatialHash()), size_t triggerEventCapacity = DEFAULT_EVENT_CAPACITY)
+			: map(map), broadphase(std::move(broadphase)), triggers(triggerEventCapacity) {}
+
+		// Swaps the broadphase implementation | The new one is filled on the next step
+		void setBroadphase(std::unique_ptr<Broadphase> newBroadphase) {
+			broadphase = std::move(newBroadphase);
+		}
+
+		// Spreads the step over the pool's threads | Results don't depend on the thread count
+		void setWorkerPool(jobs::WorkerPool* workerPool) {
+			pool = workerPool;
+		}
+
+		// Bus LandingEvents go to | Set its lanes to the pool's thread count, the tile pass publishes from every thread
+		void setEventBus(events::EventBus* eventBus) {
+			bus = eventBus;
+		}
+
+		const Broadphase& getBroadphase() const {
+			return *broadphase;
+		}
+
+		const gameMap::Map& getMap() const {
+			return *map;
+		}
+
+		BodyBounds bounds() const {
+			return { size(), activeCount(), awakeCount, sleepVersion, parkedVersion, CONTACT_MARGIN, posX.data(), posY.data(), halfW.data(), halfH.data(), denseSlot.data(), slotIndex.data() };
+		}
+
+		size_t size() const {
+			return posX.size();
+		}
+
+		// Farthest an awake body moved along either axis since the broadphase was last updated
+		// Queries made between steps pad their broadphase lookups by it
+		float broadphaseDrift() const {
+			real drift = real(0);
+			for (size_t i = 0; i < awakeCount; ++i)
+				drift = std::max(drift, std::max(abs(posX[i] - prevX[i]), abs(posY[i] - prevY[i])));
+			return toFloat(drift);
+		}
+
+		size_t awake() const {
+			return awakeCount;
+		}
+
+		// Awake bodies stepped every tick
+		size_t fullRate() const {
+			return fullCount;
+		}
+
+		size_t frozen() const {
+			return frozenCount;
+		}
+
+		// Turns on level of detail around the view rectangle | Tiers follow it from the next wide tick on
+		void setView(glm::vec2 min, glm::vec2 max) {
+			viewSet = true;
+			viewMin = min;
+			viewMax = max;
+		}
+
+		// Every body is back at full rate and thawed after the next wide tick
+		void clearView() {
+			viewSet = false;
+		}
+
+		void reserve(size_t count) {
+			posX.reserve(count); posY.reserve(count); prevX.reserve(count); prevY.reserve(count);
+			velX.reserve(count); velY.reserve(count);
+			halfW.reserve(count); halfH.reserve(count);
+			invMass.reserve(count);
+			sleepTime.reserve(count);
+			island.reserve(count);
+			flags.reserve(count);
+			denseSlot.reserve(count);
+		}
+
+		// New bodies start awake | invMass 0 makes a body immovable by contacts
+		BodyHandle addBody(glm::vec2 pos, glm::vec2 halfExtents, glm::vec2 velocity = glm::vec2(0), float inverseMass = 1.0f) {
+			uint32_t slot;
+			if (freeSlots.empty()) {
+				slot = static_cast<uint32_t>(slotIndex.size());
+				slotIndex.push_back(0);
+				slotGeneration.push_back(0);
+				islandNext.push_back(NO_SLOT);
+			}
+			else {
+				slot = freeSlots.back();
+				freeSlots.pop_back();
+			}
+
+			slotIndex[slot] = static_cast<uint32_t>(size());
+			denseSlot.push_back(slot);
+			posX.push_back(toReal(pos.x)); posY.push_back(toReal(pos.y));
+			prevX.push_back(toReal(pos.x)); prevY.push_back(toReal(pos.y));
+			velX.push_back(toReal(velocity.x)); velY.push_back(toReal(velocity.y));
+			halfW.push_back(toReal(halfExtents.x)); halfH.push_back(toReal(halfExtents.y));
+			invMass.push_back(toReal(inverseMass));
+			sleepTime.push_back(real(0));
+			island.push_back(NO_ISLAND);
+			flags.push_back(0);
+
+			moveAwake(slotIndex[slot]);
+			return makeHandle(slot, slotGeneration[slot]);
+		}
+
+		// Swaps the last body into the freed dense index | Handles of other bodies stay valid
+		void removeBody(BodyHandle body) {
+			if (!isValid(body))
+				return;
+			uint32_t slot = body & SLOT_MASK;
+			uint32_t i = slotIndex[slot];
+
+			if (i < awakeCount) {
+				leaveAwakeRange(i);
+				i = static_cast<uint32_t>(awakeCount);
+			}
+			else if (island[i] == FROZEN_ISLAND) {
+				--frozenCount;
+			}
+			else {
+				removeFromIsland(island[i], slot);
+			}
+			swapBodies(i, static_cast<uint32_t>(size()) - 1);
+			popBody();
+			broadphase->remove(slot);
+			// It may have been in either list the broadphase only rebuilds on a version change
+			++sleepVersion;
+			++parkedVersion;
+
+			slotGeneration[slot] = (slotGeneration[slot] + 1) & (0xFFFFFFFF >> SLOT_BITS);
+			freeSlots.push_back(slot);
+		}
+
+		bool isValid(BodyHandle body) const {
+			uint32_t slot = body & SLOT_MASK;
+			return slot < slotIndex.size() && slotGeneration[slot] == (body >> SLOT_BITS);
+		}
+
+		// Dense index of a body | Only valid until bodies are added, removed, woken or put to sleep
+		uint32_t index(BodyHandle body) const {
+			return slotIndex[body & SLOT_MASK];
+		}
+
+		// Handle of the body at a dense index
+		BodyHandle handle(uint32_t i) const {
+			return makeHandle(denseSlot[i], slotGeneration[denseSlot[i]]);
+		}
+
+		bool isAwake(BodyHandle body) const {
+			return index(body) < awakeCount;
+		}
+
+		// Wakes the body together with every body it fell asleep with
+		void wake(BodyHandle body) {
+			uint32_t i = index(body);
+			if (i < awakeCount)
+				sleepTime[i] = real(0);
+			else if (island[i] == FROZEN_ISLAND)
+				moveAwake(i);
+			else
+				wakeIsland(island[i]);
+		}
+
+		glm::vec2 getPos(BodyHandle body) const {
+			uint32_t i = index(body);
+			return glm::vec2(toFloat(posX[i]), toFloat(posY[i]));
+		}
+
+		glm::vec2 getPrevPos(BodyHandle body) const {
+			uint32_t i = index(body);
+			return glm::vec2(toFloat(prevX[i]), toFloat(prevY[i]));
+		}
+
+		glm::vec2 getVelocity(BodyHandle body) const {
+			uint32_t i = index(body);
+			return glm::vec2(toFloat(velX[i]), toFloat(velY[i]));
+		}
+
+		// Moves a body without sweeping it and stops it | Render interpolation starts over at the new spot
+		void teleport(BodyHandle body, glm::vec2 pos) {
+			wake(body);
+			uint32_t i = index(body);
+			posX[i] = prevX[i] = toReal(pos.x);
+			posY[i] = prevY[i] = toReal(pos.y);
+			velX[i] = velY[i] = real(0);
+		}
+
+		// Moves a body without sweeping it and keeps its last position | Used by constraints that place bodies themselves
+		void setPosition(BodyHandle body, glm::vec2 pos) {
+			wake(body);
+			uint32_t i = index(body);
+			posX[i] = toReal(pos.x);
+			posY[i] = toReal(pos.y);
+		}
+
+		// A non-zero velocity wakes the body
+		void setVelocity(BodyHandle body, glm::vec2 velocity) {
+			if (velocity != glm::vec2(0))
+				wake(body);
+			uint32_t i = index(body);
+			velX[i] = toReal(velocity.x);
+			velY[i] = toReal(velocity.y);
+		}
+
+		// tag is handed back with every event of the trigger
+		TriggerHandle addTrigger(glm::vec2 min, glm::vec2 max, uint32_t tag = 0) {
+			return triggers.add(min, max, tag);
+		}
+
+		void removeTrigger(TriggerHandle trigger) {
+			triggers.remove(trigger);
+		}
+
+		// Trigger events of the last step | Valid until the next one
+		const std::vector<TriggerEvent>& getTriggerEvents() const {
+			return triggers.getEvents();
+		}
+
+		const TriggerSet& getTriggers() const {
+			return triggers;
+		}
+
+		// Wakes bodies touching cells edited since the last step
+		void wakeEditedCells() {
+			if (map->getEdits().empty())
+				return;
+			BodyBounds b = bounds();
+			queryResult.clear();
+			for (glm::uvec2 cell : map->getEdits())
+				broadphase->query(b, glm::vec2(cell) - glm::vec2(toFloat(CONTACT_MARGIN)), glm::vec2(cell) + glm::vec2(1 + toFloat(CONTACT_MARGIN)), queryResult);
+			map->clearEdits();
+
+			toWake.clear();
+			for (uint32_t i : queryResult) {
+				if (i >= awakeCount)
+					toWake.push_back(island[i]);
+			}
+			std::sort(toWake.begin(), toWake.end());
+			toWake.erase(std::unique(toWake.begin(), toWake.end()), toWake.end());
+			for (uint32_t id : toWake)
+				wakeIsland(id);
+		}
+
+		// Applies gravity and stores the last position | Branch free so the compiler can vectorize it
+		void integrateRange(size_t begin, size_t end, real gx, real gy) {
+			real* __restrict px = posX.data();
+			real* __restrict py = posY.data();
+			real* __restrict ox = prevX.data();
+			real* __restrict oy = prevY.data();
+			real* __restrict vx = velX.data();
+			real* __restrict vy = velY.data();
+
+			for (size_t i = begin; i < end; ++i) {
+				ox[i] = px[i];
+				oy[i] = py[i];
+				vx[i] += gx;
+				vy[i] += gy;
+			}
+		}
+
+		void integrate(real dt) {
+			real gx = toReal(gravity.x) * dt, gy = toReal(gravity.y) * dt;
+			real scale = real(detail.reducedInterval);
+			stats.integrated = static_cast<uint32_t>(activeCount());
+			forBatches(activeCount(), [&](size_t begin, size_t end) {
+				size_t split = std::max(begin, std::min(end, fullCount));
+				integrateRange(begin, split, gx, gy);
+				integrateRange(split, end, gx * scale, gy * scale);
+			});
+		}
+
+		// Moves every awake body by its velocity plus the solver's push, sweeping it against the tile grid
+		void collideTiles(real dt) {
+			pushX.resize(activeCount(), real(0));
+			pushY.resize(activeCount(), real(0));
+			size_t batches = (activeCount() + BODY_BATCH - 1) / BODY_BATCH;
+			batchProbes.resize(std::max(batchProbes.size(), batches));
+			forBatches(activeCount(), [&](size_t begin, size_t end) {
+				uint32_t probed = probedCells();
+				for (uint32_t i = static_cast<uint32_t>(begin); i < end; ++i) {
+					real h = stepTime(i, dt);
+					SweepResult moved = sweepBox(*map, posX[i], posY[i], halfW[i], halfH[i], (velX[i] + pushX[i]) * h, (velY[i] + pushY[i]) * h);
+					posX[i] = moved.x;
+					posY[i] = moved.y;
+
+					uint8_t f = 0;
+					if (moved.hitX) {
+						velX[i] = real(0);
+						f |= BODY_HIT_WALL;
+					}
+					if (moved.hitY) {
+						f |= velY[i] < real(0) ? BODY_ON_GROUND : BODY_HIT_CEILING;
+						if (bus && (f & BODY_ON_GROUND) && !(flags[i] & BODY_ON_GROUND))
+							bus->publish(LandingEvent{ handle(i), -toFloat(velY[i]) });
+						velY[i] = real(0);
+					}
+					flags[i] = f;
+				}
+				batchProbes[begin / BODY_BATCH] = probedCells() - probed;
+			});
+			sumProbes(batches);
+		}
+
+		void findPairs() {
+			pairs.clear();
+			BodyBounds b = bounds();
+			broadphase->update(b);
+			broadphase->findPairs(b, pairs);
+			stats.candidates = static_cast<uint32_t>(broadphase->candidates);
+			stats.pairs = static_cast<uint32_t>(pairs.size());
+		}
+
+		// Collects the bodies inside each trigger and turns the changes into events
+		// Runs on the freshly updated broadphase, so it sees the bodies where the last step left them
+		void findTriggerOverlaps() {
+			triggers.begin();
+			BodyBounds b = bounds();
+			for (uint32_t k = 0; k < triggers.size(); ++k) {
+				TriggerHandle t = triggers.handle(k);
+				if (!triggers.isActive(t))
+					continue;
+				queryResult.clear();
+				broadphase->query(b, triggers.getMin(t), triggers.getMax(t), queryResult);
+				for (uint32_t i : queryResult) {
+					if (triggers.contains(t, posX[i], posY[i], halfW[i], halfH[i]))
+						triggers.overlap(t, handle(i));
+				}
+			}
+			triggers.end();
+		}
+
+		// Turns pairs into contacts and adds contacts against tiles next to awake bodies
+		void findContacts() {
+			contacts.clear();
+			for (const BodyPair& p : pairs) {
+				real dx = posX[p.b] - posX[p.a], dy = posY[p.b] - posY[p.a];
+				real overlapX = halfW[p.a] + halfW[p.b] - abs(dx);
+				real overlapY = halfH[p.a] + halfH[p.b] - abs(dy);
+				if (overlapX < overlapY)
+					addContact(contacts, p.a, p.b, 0, dx < real(0) ? -1 : 1, -overlapX);
+				else
+					addContact(contacts, p.a, p.b, 1, dy < real(0) ? -1 : 1, -overlapY);
+			}
+
+			// Every batch writes its own list, appended in batch order to stay deterministic
+			size_t batches = (activeCount() + BODY_BATCH - 1) / BODY_BATCH;
+			batchContacts.resize(batches);
+			batchProbes.resize(std::max(batchProbes.size(), batches));
+			forBatches(activeCount(), [&](size_t begin, size_t end) {
+				std::vector<Contact>& to = batchContacts[begin / BODY_BATCH];
+				to.clear();
+				uint32_t probed = probedCells();
+				for (uint32_t i = static_cast<uint32_t>(begin); i < end; ++i) {
+					real min[2] = { posX[i] - halfW[i], posY[i] - halfH[i] };
+					real max[2] = { posX[i] + halfW[i], posY[i] + halfH[i] };
+					for (int axis = 0; axis < 2; ++axis) {
+						for (int dir = -1; dir <= 1; dir += 2) {
+							real gap;
+							if (probeFace(*map, axis, min, max, dir, CONTACT_MARGIN, gap))
+								addContact(to, i, TILE_CONTACT, axis, dir, gap);
+						}
+					}
+				}
+				batchProbes[begin / BODY_BATCH] = probedCells() - probed;
+			});
+			for (const std::vector<Contact>& batch : batchContacts)
+				contacts.insert(contacts.end(), batch.begin(), batch.end());
+			sumProbes(batches);
+			stats.narrowTests = static_cast<uint32_t>(pairs.size() + 4 * activeCount());
+			stats.contacts = static_cast<uint32_t>(contacts.size());
+		}
+
+		// Joins awake bodies touching each other and groups the contacts by island, keeping their order
+		void buildIslands() {
+			size_t active = activeCount();
+			islandParent.resize(active);
+			for (uint32_t i = 0; i < active; ++i)
+				islandParent[i] = i;
+			for (const Contact& c : contacts) {
+				if (c.b < active)
+					islandParent[findRoot(c.a)] = findRoot(c.b);
+			}
+
+			rootIsland.assign(active, NO_ISLAND);
+			islandStart.clear();
+			for (const Contact& c : contacts) {
+				uint32_t root = findRoot(c.a);
+				if (rootIsland[root] == NO_ISLAND) {
+					rootIsland[root] = static_cast<uint32_t>(islandStart.size());
+					islandStart.push_back(0);
+				}
+				++islandStart[rootIsland[root]];
+			}
+
+			// Counts to offsets, then scatter
+			uint32_t offset = 0;
+			for (uint32_t& start : islandStart) {
+				uint32_t count = start;
+				start = offset;
+				offset += count;
+			}
+			islandStart.push_back(offset);
+			islandContacts.resize(contacts.size());
+			islandFill.assign(islandStart.begin(), islandStart.end() - 1);
+			for (uint32_t c = 0; c < contacts.size(); ++c)
+				islandContacts[islandFill[rootIsland[findRoot(contacts[c].a)]]++] = c;
+			stats.islands = static_cast<uint32_t>(islandStart.size() - 1);
+		}
+
+		void solveIsland(size_t k, real dt) {
+			if (warmStarting) {
+				for (uint32_t n = islandStart[k]; n < islandStart[k + 1]; ++n) {
+					Contact& c = contacts[islandContacts[n]];
+					c.impulse = cachedImpulse(c.key);
+					applyImpulse(c, c.impulse, velX, velY);
+				}
+			}
+
+			// Velocities only stop approach, a gap may still shut exactly this tick
+			for (int iteration = 0; iteration < solverIterations; ++iteration) {
+				for (uint32_t n = islandStart[k]; n < islandStart[k + 1]; ++n) {
+					Contact& c = contacts[islandContacts[n]];
+					real target = c.separation > real(0) ? -c.separation / contactStepTime(c, dt) : real(0);
+					solveNormal(c, target, c.impulse, velX, velY);
+				}
+			}
+
+			// Penetration is pushed out separately | Folding it into the warm started impulse would feed it back every tick
+			for (int iteration = 0; iteration < solverIterations; ++iteration) {
+				for (uint32_t n = islandStart[k]; n < islandStart[k + 1]; ++n) {
+					Contact& c = contacts[islandContacts[n]];
+					if (-c.separation > CONTACT_SLOP)
+						solveNormal(c, BAUMGARTE * (-c.separation - CONTACT_SLOP) / contactStepTime(c, dt), c.pushImpulse, pushX, pushY);
+				}
+			}
+		}
+
+		// Sequential impulses on the contact normals | Sleeping, frozen and parked bodies and tiles act as immovable
+		// Islands share no awake body, so each one is solved as its own task
+		void solveContacts(real dt) {
+			pushX.assign(activeCount(), real(0));
+			pushY.assign(activeCount(), real(0));
+			if (!islandStart.empty()) {
+				size_t islands = islandStart.size() - 1;
+				if (pool)
+					pool->run(islands, [&](size_t k) { solveIsland(k, dt); });
+				else
+					for (size_t k = 0; k < islands; ++k)
+						solveIsland(k, dt);
+				stats.solverIterations = islands > 0 ? 2 * solverIterations : 0;
+			}
+
+			cacheImpulses();
+		}
+
+		// Puts resting islands to sleep and wakes sleepers that got hit
+		void updateSleep(real dt) {
+			toWake.clear();
+			for (const Contact& c : contacts) {
+				// Impacts wake the sleeper's island, resting on it does not
+				if (c.b != TILE_CONTACT && c.b >= awakeCount && velX[c.a] * velX[c.a] + velY[c.a] * velY[c.a] > SLEEP_VELOCITY * SLEEP_VELOCITY)
+					toWake.push_back(island[c.b]);
+			}
+
+			size_t active = activeCount();
+			islandSleepTime.assign(active, TIME_TO_SLEEP);
+			for (uint32_t i = 0; i < active; ++i) {
+				bool resting = velX[i] * velX[i] + velY[i] * velY[i] < SLEEP_VELOCITY * SLEEP_VELOCITY;
+				sleepTime[i] = resting ? sleepTime[i] + stepTime(i, dt) : real(0);
+				uint32_t root = findRoot(i);
+				islandSleepTime[root] = std::min(islandSleepTime[root], sleepTime[i]);
+			}
+
+			// Collect by slot first, dense indices shift while bodies move between the ranges
+			islandOfRoot.assign(active, NO_ISLAND);
+			bool anyAsleep = false;
+			for (uint32_t i = 0; i < active; ++i) {
+				uint32_t root = findRoot(i);
+				if (islandSleepTime[root] < TIME_TO_SLEEP)
+					continue;
+				if (islandOfRoot[root] == NO_ISLAND)
+					islandOfRoot[root] = allocateIsland();
+				appendToIsland(islandOfRoot[root], denseSlot[i]);
+				anyAsleep = true;
+			}
+
+			std::sort(toWake.begin(), toWake.end());
+			toWake.erase(std::unique(toWake.begin(), toWake.end()), toWake.end());
+			for (uint32_t id : toWake)
+				wakeIsland(id);
+
+			if (!anyAsleep)
+				return;
+			for (uint32_t root = 0; root < islandOfRoot.size(); ++root) {
+				uint32_t id = islandOfRoot[root];
+				if (id == NO_ISLAND)
+					continue;
+				for (uint32_t slot = islandFirst[id]; slot != NO_SLOT; slot = islandNext[slot])
+					moveAsleep(slotIndex[slot], id);
+			}
+			++sleepVersion;
+		}
+
+		// Freezes awake bodies out of reach, thaws frozen ones back in reach and moves the rest between the full and reduced rate ranges
+		// Only runs right after a wide tick, when no body is behind, so positions and velocities carry over between tiers as they are
+		void updateDetail() {
+			const float far = 1e30f;
+			toMove.clear();
+			if (viewSet) {
+				// Frozen bodies never move, the broadphase still knows where they are
+				glm::vec2 reach(detail.freezeDistance - DETAIL_HYSTERESIS);
+				queryResult.clear();
+				broadphase->query(bounds(), viewMin - reach, viewMax + reach, queryResult);
+				for (uint32_t i : queryResult) {
+					if (island[i] == FROZEN_ISLAND && viewDistance(i) < detail.freezeDistance - DETAIL_HYSTERESIS)
+						toMove.push_back(handle(i));
+				}
+			}
+			else if (frozenCount > 0) {
+				for (uint32_t i = static_cast<uint32_t>(awakeCount); i < size(); ++i) {
+					if (island[i] == FROZEN_ISLAND)
+						toMove.push_back(handle(i));
+				}
+			}
+			for (BodyHandle body : toMove)
+				moveAwake(index(body));
+
+			toMove.clear();
+			for (uint32_t i = 0; i < awakeCount; ++i) {
+				if (viewSet && viewDistance(i) > detail.freezeDistance)
+					toMove.push_back(handle(i));
+			}
+			for (BodyHandle body : toMove)
+				freeze(index(body));
+			if (!toMove.empty())
+				++sleepVersion;
+
+			for (uint32_t i = 0; i < fullCount;) {
+				if ((viewSet ? viewDistance(i) : -far) > detail.fullDistance) {
+					--fullCount;
+					swapBodies(i, static_cast<uint32_t>(fullCount));
+				}
+				else {
+					++i;
+				}
+			}
+			for (uint32_t i = static_cast<uint32_t>(fullCount); i < awakeCount; ++i) {
+				if ((viewSet ? viewDistance(i) : -far) < detail.fullDistance - DETAIL_HYSTERESIS)
+					swapBodies(i, static_cast<uint32_t>(fullCount++));
+			}
+		}
+
+		// FNV-1a over the body state in dense order | Equal hashes mean bit identical simulations
+		uint64_t stateHash() const {
+			uint64_t hash = 14695981039346656037ull;
+			const std::vector<real>* arrays[] = { &posX, &posY, &velX, &velY };
+			for (const std::vector<real>* a : arrays) {
+				const unsigned char* bytes = reinterpret_cast<const unsigned char*>(a->data());
+				for (size_t i = 0; i < a->size() * sizeof(real); ++i) {
+					hash ^= bytes[i];
+					hash *= 1099511628211ull;
+				}
+			}
+			return hash;
+		}
+
+		// Copies the simulation state into buffer | Settings, scratch buffers and the broadphase are left out
+		void save(StateBuffer& buffer) const {
+			buffer.write(awakeCount);
+			buffer.write(fullCount);
+			buffer.write(frozenCount);
+			buffer.write(viewSet);
+			buffer.write(viewMin);
+			buffer.write(viewMax);
+			buffer.write(tickCount);
+			buffer.write(wideTick);
+			buffer.write(impulseMask);
+
+			const std::vector<real>* arrays[] = { &posX, &posY, &prevX, &prevY, &velX, &velY, &halfW, &halfH, &invMass, &sleepTime };
+			for (const std::vector<real>* a : arrays)
+				buffer.writeArray(*a);
+			buffer.writeArray(island);
+			buffer.writeArray(flags);
+			buffer.writeArray(denseSlot);
+
+			buffer.writeArray(slotIndex);
+			buffer.writeArray(slotGeneration);
+			buffer.writeArray(freeSlots);
+			buffer.writeArray(islandFirst);
+			buffer.writeArray(islandLast);
+			buffer.writeArray(islandNext);
+			buffer.writeArray(freeIslands);
+			buffer.writeArray(impulseCache);
+			triggers.save(buffer);
+		}
+
+		// Puts back a state written by save | The broadphase catches up on the next step, queries before it see the old bodies
+		// Stepping on reproduces the original run bit for bit with the SpatialHash, the AabbTree's pair order depends on its history
+		void restore(StateBuffer& buffer) {
+			slotUsed.assign(slotIndex.size(), 0);
+			for (uint32_t slot : denseSlot)
+				slotUsed[slot] = 1;
+
+			buffer.read(awakeCount);
+			buffer.read(fullCount);
+			buffer.read(frozenCount);
+			buffer.read(viewSet);
+			buffer.read(viewMin);
+			buffer.read(viewMax);
+			buffer.read(tickCount);
+			buffer.read(wideTick);
+			buffer.read(impulseMask);
+
+			std::vector<real>* arrays[] = { &posX, &posY, &prevX, &prevY, &velX, &velY, &halfW, &halfH, &invMass, &sleepTime };
+			for (std::vector<real>* a : arrays)
+				buffer.readArray(*a);
+			buffer.readArray(island);
+			buffer.readArray(flags);
+			buffer.readArray(denseSlot);
+
+			buffer.readArray(slotIndex);
+			buffer.readArray(slotGeneration);
+			buffer.readArray(freeSlots);
+			buffer.readArray(islandFirst);
+			buffer.readArray(islandLast);
+			buffer.readArray(islandNext);
+			buffer.readArray(freeIslands);
+			buffer.readArray(impulseCache);
+			triggers.restore(buffer);
+
+			// Bodies that only existed in the replaced state leave the broadphase, the rest is refreshed on the next update
+			for (uint32_t slot : denseSlot) {
+				if (slot < slotUsed.size())
+					slotUsed[slot] = 0;
+			}
+			for (uint32_t slot = 0; slot < slotUsed.size(); ++slot) {
+				if (slotUsed[slot])
+					broadphase->remove(slot);
+			}
+			++sleepVersion;
+			++parkedVersion;
+		}
+
+		void step(float dt) {
+			stats = StepStats();
+			util::chrono::point start = phaseStart = util::chrono::now();
+			real h = toReal(dt);
+			// Reduced rate bodies join every reducedInterval ticks | Without any every tick is wide
+			bool detailTick = tickCount++ % static_cast<uint64_t>(detail.reducedInterval) == 0;
+			bool wasWide = wideTick;
+			wideTick = detailTick || fullCount == awakeCount;
+			// They moved in the last wide tick
+			if (wasWide && !wideTick)
+				++parkedVersion;
+
+			wakeEditedCells();
+			endPhase(PHASE_WAKE);
+			integrate(h);
+			endPhase(PHASE_INTEGRATE);
+			findPairs();
+			endPhase(PHASE_PAIRS);
+			findTriggerOverlaps();
+			endPhase(PHASE_TRIGGERS);
+			findContacts();
+			endPhase(PHASE_CONTACTS);
+			buildIslands();
+			endPhase(PHASE_ISLANDS);
+			solveContacts(h);
+			endPhase(PHASE_SOLVE);
+			collideTiles(h);
+			endPhase(PHASE_TILES);
+			updateSleep(h);
+			endPhase(PHASE_SLEEP);
+			if (detailTick && (viewSet || fullCount != awakeCount || frozenCount > 0))
+				updateDetail();
+			endPhase(PHASE_DETAIL);
+			stats.totalMs = util::chrono::deltaTime(start, phaseStart) * 1000;
+		}
+	};
+}
\ No newline at end of file
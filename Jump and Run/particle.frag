@@ -0,0 +1,13 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 corner;
+in float fade;
+
+uniform vec4 color;
+
+// Round dot with a soft edge | corner runs from -0.5 to 0.5 across the quad
+void main() {
+	float edge = 1.0 - smoothstep(0.3, 0.5, length(corner));
+	FragColor = vec4(color.rgb, color.a * fade * edge);
+}
\ No newline at end of file
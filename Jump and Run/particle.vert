@@ -0,0 +1,16 @@
+#version 330 core
+layout (location = 0) in vec2 aCorner;
+layout (location = 1) in vec4 aInstance;
+
+out vec2 corner;
+out float fade;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+// aInstance is position, edge length and alpha of one particle
+void main() {
+	gl_Position = projection * view * vec4(aInstance.xy + aCorner * aInstance.z, -1.0, 1.0);
+	corner = aCorner;
+	fade = aInstance.w;
+}
\ No newline at end of file
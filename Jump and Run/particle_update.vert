@@ -0,0 +1,58 @@
+#version 330 core
+layout (location = 0) in vec4 aInstance;
+layout (location = 1) in vec4 aMotion;
+
+// Captured by transform feedback into the other buffer of the pair, interleaved like the input
+out vec4 instance;
+out vec4 motion;
+
+uniform float dt;
+// Gravity times the material's scale times dt, and the share of the velocity drag leaves over
+uniform float fall;
+uniform float keep;
+uniform float startSize;
+uniform float grow;
+uniform bool collides;
+uniform float bounce;
+uniform float friction;
+// One texel per map cell, solid ones above 0.5
+uniform sampler2D tiles;
+
+bool solid(vec2 pos) {
+	ivec2 cell = ivec2(floor(pos));
+	if (any(lessThan(cell, ivec2(0))) || any(greaterThanEqual(cell, textureSize(tiles, 0))))
+		return false;
+	return texelFetch(tiles, cell, 0).r > 0.5;
+}
+
+// aInstance is position, edge length and alpha as particle.vert draws it, aMotion is velocity, age and 1 / lifetime
+// Same steps as ParticleSystem's advance and collide | Dead particles stay put with nothing left to draw
+void main() {
+	if (aMotion.z * aMotion.w >= 1.0) {
+		instance = vec4(aInstance.xy, 0.0, 0.0);
+		motion = aMotion;
+		return;
+	}
+
+	vec2 vel = vec2(aMotion.x, aMotion.y + fall) * keep;
+	vec2 from = aInstance.xy;
+	vec2 pos = from + vel * dt;
+	float age = aMotion.z + dt;
+
+	if (collides && solid(pos)) {
+		float toY = pos.y;
+		if (solid(vec2(pos.x, from.y))) {
+			pos.x = from.x;
+			vel.x *= -bounce;
+		}
+		if (solid(vec2(pos.x, toY))) {
+			pos.y = from.y;
+			vel.y *= -bounce;
+			vel.x *= friction;
+		}
+	}
+
+	float t = age * aMotion.w;
+	instance = t < 1.0 ? vec4(pos, startSize + grow * t, 1.0 - t) : vec4(pos, 0.0, 0.0);
+	motion = vec4(vel, age, aMotion.w);
+}
\ No newline at end of file
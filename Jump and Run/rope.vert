@@ -0,0 +1,10 @@
+#version 330 core
+layout (location = 0) in vec2 aPos;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+// aPos is one rope particle, already interpolated between the last two ticks
+void main() {
+	gl_Position = projection * view * vec4(aPos, -1.0, 1.0);
+}
\ No newline at end of file